@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+#Command to install the testers:
+# npm install
+
+# a 200ms handler on the worker pool (one task per request) vs as a coroutine (shared tasks)
+# needs the firmware built with the coroutines env
+
+TEST_IP="psychic.local"
+TEST_TIME=10
+LOG_FILE=_psychic-coroutine-loadtest.json
+RESULTS_FILE=coroutine-loadtest-results.csv
+WORKERS=1
+PROTOCOL=http
+#PROTOCOL=https
+
+echo "url,connections,rps,latency,errors" > $RESULTS_FILE
+
+for ENDPOINT in slow-worker slow-coroutine
+do
+  for CONCURRENCY in 1 4 8 12
+  do
+    echo "Testing $CONCURRENCY clients on $PROTOCOL://$TEST_IP/$ENDPOINT"
+    autocannon -c $CONCURRENCY -w $WORKERS -d $TEST_TIME -j "$PROTOCOL://$TEST_IP/$ENDPOINT" > $LOG_FILE
+    node parse-http-test.js $LOG_FILE $RESULTS_FILE
+    sleep 5
+  done
+done
+
+rm $LOG_FILE
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+#Command to install the testers:
+# npm install
+
+# compares plain chunked file sending with the pipelined (read-ahead) mode.
+# put a large file (eg. 500kb+) in data/www to see the difference clearly.
+
+TEST_IP="psychic.local"
+TEST_TIME=10
+TEST_FILE=${1:-alien.png}
+LOG_FILE=_psychic-file-loadtest.json
+RESULTS_FILE=file-loadtest-results.csv
+WORKERS=1
+PROTOCOL=http
+#PROTOCOL=https
+
+echo "url,connections,rps,latency,errors" > $RESULTS_FILE
+
+for URL in "$TEST_FILE" "pipelined/$TEST_FILE"
+do
+  for CONCURRENCY in 1 2 3 4 5
+  do
+    echo "Testing $CONCURRENCY clients on $PROTOCOL://$TEST_IP/$URL"
+    autocannon -c $CONCURRENCY -w $WORKERS -d $TEST_TIME -j "$PROTOCOL://$TEST_IP/$URL" > $LOG_FILE
+    node parse-http-test.js $LOG_FILE $RESULTS_FILE
+    sleep 5
+  done
+done
+
+rm $LOG_FILE
@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+#Command to install the testers:
+# npm install
+
+# PsychicJsonResponse throughput across document sizes from 100b to 100kb
+
+TEST_IP="psychic.local"
+TEST_TIME=10
+LOG_FILE=_psychic-json-loadtest.json
+RESULTS_FILE=json-loadtest-results.csv
+WORKERS=1
+PROTOCOL=http
+#PROTOCOL=https
+
+echo "url,connections,rps,latency,errors" > $RESULTS_FILE
+
+for SIZE in 100 1000 4000 10000 50000 100000
+do
+  for CONCURRENCY in 1 2 5
+  do
+    echo "Testing $CONCURRENCY clients on $PROTOCOL://$TEST_IP/json?size=$SIZE"
+    autocannon -c $CONCURRENCY -w $WORKERS -d $TEST_TIME -j "$PROTOCOL://$TEST_IP/json?size=$SIZE" > $LOG_FILE
+    node parse-http-test.js $LOG_FILE $RESULTS_FILE
+    sleep 5
+  done
+done
+
+rm $LOG_FILE
@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+#Command to install the testers:
+# npm install
+
+# the same tiny response behind 0, 4 and 16 pass-through middleware, and 4 in a PsychicStaticMiddlewareChain
+# the in-place cost per layer (no network) is printed first, from /middleware-cost
+
+TEST_IP="psychic.local"
+TEST_TIME=10
+LOG_FILE=_psychic-middleware-loadtest.json
+RESULTS_FILE=middleware-loadtest-results.csv
+WORKERS=1
+PROTOCOL=http
+#PROTOCOL=https
+
+curl -s "$PROTOCOL://$TEST_IP/middleware-cost" > middleware-cost-results.csv
+cat middleware-cost-results.csv
+
+echo "url,connections,rps,latency,errors" > $RESULTS_FILE
+
+for ENDPOINT in middleware-0 middleware-4 middleware-16 middleware-static-4
+do
+  for CONCURRENCY in 1 4 8
+  do
+    echo "Testing $CONCURRENCY clients on $PROTOCOL://$TEST_IP/$ENDPOINT"
+    autocannon -c $CONCURRENCY -w $WORKERS -d $TEST_TIME -j "$PROTOCOL://$TEST_IP/$ENDPOINT" > $LOG_FILE
+    node parse-http-test.js $LOG_FILE $RESULTS_FILE
+    sleep 5
+  done
+done
+
+rm $LOG_FILE
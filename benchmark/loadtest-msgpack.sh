@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+#Command to install the testers:
+# npm install
+
+# JSON vs MessagePack from the same PsychicJsonResponse, picked by the Accept header
+
+TEST_IP="psychic.local"
+TEST_TIME=10
+LOG_FILE=_psychic-msgpack-loadtest.json
+RESULTS_FILE=msgpack-loadtest-results.csv
+SIZES_FILE=msgpack-sizes.csv
+WORKERS=1
+PROTOCOL=http
+#PROTOCOL=https
+
+echo "url,connections,rps,latency,errors" > $RESULTS_FILE
+echo "size,format,bytes" > $SIZES_FILE
+
+for SIZE in 100 1000 4000 10000 50000
+do
+  for FORMAT in application/json application/msgpack
+  do
+    BYTES=$(curl -s -H "Accept: $FORMAT" "$PROTOCOL://$TEST_IP/json?size=$SIZE" | wc -c)
+    echo "$SIZE,$FORMAT,$BYTES" >> $SIZES_FILE
+
+    for CONCURRENCY in 1 5
+    do
+      echo "Testing $CONCURRENCY clients on $PROTOCOL://$TEST_IP/json?size=$SIZE as $FORMAT"
+      autocannon -c $CONCURRENCY -w $WORKERS -d $TEST_TIME -H "Accept: $FORMAT" -j "$PROTOCOL://$TEST_IP/json?size=$SIZE" > $LOG_FILE
+      node parse-http-test.js $LOG_FILE $RESULTS_FILE
+      sleep 5
+    done
+  done
+done
+
+rm $LOG_FILE
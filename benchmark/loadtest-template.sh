@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+#Command to install the testers:
+# npm install
+
+# TemplatePrinter vs the precompiled PsychicTemplate rendering the same page
+
+TEST_IP="psychic.local"
+TEST_TIME=10
+LOG_FILE=_psychic-template-loadtest.json
+RESULTS_FILE=template-loadtest-results.csv
+WORKERS=1
+PROTOCOL=http
+#PROTOCOL=https
+
+echo "url,connections,rps,latency,errors" > $RESULTS_FILE
+
+for ENDPOINT in template-printer template-compiled
+do
+  for CONCURRENCY in 1 2 5
+  do
+    echo "Testing $CONCURRENCY clients on $PROTOCOL://$TEST_IP/$ENDPOINT"
+    autocannon -c $CONCURRENCY -w $WORKERS -d $TEST_TIME -j "$PROTOCOL://$TEST_IP/$ENDPOINT" > $LOG_FILE
+    node parse-http-test.js $LOG_FILE $RESULTS_FILE
+    sleep 5
+  done
+done
+
+rm $LOG_FILE
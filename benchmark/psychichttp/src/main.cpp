@@ -13,6 +13,7 @@
 #include <ESPmDNS.h>
 #include <LittleFS.h>
 #include <PsychicHttp.h>
+#include <TemplatePrinter.h>
 #include <WiFi.h>
 
 #ifndef WIFI_SSID
@@ -175,6 +176,9 @@ void setup()
     // serve static files from LittleFS/www on /
     server.serveStatic("/", LittleFS, "/www/");
 
+    // same files, but read ahead on a helper task while the previous chunk is sent (see loadtest-file.sh)
+    server.serveStatic("/pipelined", LittleFS, "/www/")->setPipelined(true);
+
     // a websocket echo server
     websocketHandler.onOpen([](PsychicWebSocketClient* client) {
       // client->sendMessage("Hello!");
@@ -208,6 +212,111 @@ void setup()
       serializeJson(output, jsonBuffer);
       return response->send(200, "application/json", jsonBuffer.c_str()); });
 
+    // json of roughly ?size=N bytes, to compare PsychicJsonResponse across sizes (see loadtest-json.sh)
+    // send "Accept: application/msgpack" to get the same document as MessagePack (see loadtest-msgpack.sh)
+    server.on("/json", HTTP_GET, [](PsychicRequest* request, PsychicResponse* response) {
+      size_t size = 100;
+      if (request->hasParam("size"))
+        size = request->getParam("size")->value().toInt();
+
+      PsychicJsonResponse json(response, true);
+      JsonArray root = json.getRoot();
+
+      // each entry is about 50 bytes
+      for (size_t i = 0; i < size / 50 + 1; i++) {
+        JsonObject row = root.add<JsonObject>();
+        row["id"] = i;
+        row["value"] = "lorem ipsum dolor sit amet";
+      }
+
+      return json.send(); });
+
+    // the same ~18kb page through TemplatePrinter and through the precompiled PsychicTemplate (see loadtest-template.sh)
+    static TemplateCallback settingsParams = [](Print& output, const char* param) {
+      if (strcmp(param, "DEVICE_NAME") == 0)
+        output.print(local_hostname);
+      else if (strcmp(param, "FIRMWARE") == 0)
+        output.print("1.0.0");
+      else if (strcmp(param, "FREE_HEAP") == 0)
+        output.print(esp_get_free_heap_size());
+      else if (strcmp(param, "SETTING") == 0)
+        output.print(42);
+      else
+        return false;
+      return true;
+    };
+
+    server.on("/template-printer", HTTP_GET, [](PsychicRequest* request, PsychicResponse* response) {
+      File file = LittleFS.open("/www/template.html");
+      PsychicStreamResponse stream(response, "text/html");
+      stream.beginSend();
+      TemplatePrinter printer(stream, settingsParams);
+      printer.copyFrom(file);
+      printer.flush();
+      file.close();
+      return stream.endSend(); });
+
+    static PsychicTemplate settingsTemplate(LittleFS, "/www/template.html");
+    settingsTemplate.on("SETTING", [](Print& output) { output.print(42); return true; })->onParam(settingsParams);
+    server.on("/template-compiled", HTTP_GET, [](PsychicRequest* request, PsychicResponse* response) { return settingsTemplate.send(response); });
+
+    // the same tiny response behind 0, 4 and 16 pass-through middleware, and 4 compiled in (see loadtest-middleware.sh)
+    static PsychicMiddleware passthrough[16];
+    static PsychicStaticMiddlewareChain<PsychicMiddleware, PsychicMiddleware, PsychicMiddleware, PsychicMiddleware> compiled;
+    static PsychicHttpRequestCallback hello = [](PsychicRequest* request, PsychicResponse* response) { return response->send("hello"); };
+
+    server.on("/middleware-0", HTTP_GET, hello);
+    PsychicEndpoint* four = server.on("/middleware-4", HTTP_GET, hello);
+    PsychicEndpoint* sixteen = server.on("/middleware-16", HTTP_GET, hello);
+    for (int i = 0; i < 16; i++) {
+      if (i < 4)
+        four->addMiddleware(&passthrough[i]);
+      sixteen->addMiddleware(&passthrough[i]);
+    }
+    server.on("/middleware-static-4", HTTP_GET, hello)->addMiddleware(&compiled);
+
+    // cost per layer without the network in the way: runs each chain in place and reports ns per request
+    server.on("/middleware-cost", HTTP_GET, [](PsychicRequest* request, PsychicResponse* response) {
+      const int runs = 10000;
+      static PsychicMiddlewareChain chains[4];
+      static const int layers[4] = {0, 1, 4, 16};
+      for (int c = 0; c < 4; c++)
+        for (int i = chains[c].size(); i < layers[c]; i++)
+          chains[c].addMiddleware(&passthrough[i]);
+
+      PsychicMiddlewareChain wrapped;
+      wrapped.addMiddleware(&compiled);
+
+      String out = "layers,ns_per_request\n";
+      for (int c = 0; c < 5; c++) {
+        PsychicMiddlewareChain& chain = c < 4 ? chains[c] : wrapped;
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < runs; i++)
+          chain.runChain(request, []() { return ESP_OK; });
+        int64_t ns = (esp_timer_get_time() - start) * 1000 / runs;
+
+        out += c < 4 ? String(layers[c]) : String("4 (static)");
+        out += ",";
+        out += String((long)ns);
+        out += "\n";
+      }
+
+      return response->send(200, "text/csv", out.c_str()); });
+
+    // a handler that waits 200ms on something, once holding a worker task and once as a coroutine
+#ifdef ENABLE_ASYNC
+    server.on("/slow-worker", HTTP_GET, [](PsychicRequest* request, PsychicResponse* response) {
+      vTaskDelay(pdMS_TO_TICKS(200));
+      return response->send("done"); })
+      ->setOffload();
+#endif
+
+#ifdef ENABLE_COROUTINES
+    server.on("/slow-coroutine", HTTP_GET, [](PsychicRequest* request, PsychicResponse* response) -> PsychicTask {
+      co_await PsychicSleep(200);
+      co_return response->send("done"); });
+#endif
+
     server.begin();
   }
 }
@@ -1,10 +1,13 @@
-
 #include "ChunkPrinter.h"
 
 ChunkPrinter::ChunkPrinter(PsychicResponse* response, uint8_t* buffer, size_t len) : _response(response),
                                                                                      _buffer(buffer),
                                                                                      _length(len),
-                                                                                     _pos(0)
+                                                                                     _pos(0),
+                                                                                     _chunked(false),
+                                                                                     _failed(false),
+                                                                                     _flushInterval(0),
+                                                                                     _lastFlush(millis())
 {
 }
 
@@ -13,15 +16,44 @@ ChunkPrinter::~ChunkPrinter()
   flush();
 }
 
+esp_err_t ChunkPrinter::_sendChunk(uint8_t* chunk, size_t len)
+{
+  if (_failed)
+    return ESP_FAIL;
+
+  _lastFlush = millis();
+  _chunked = true;
+
+  // remembered so long running writers can notice the client went away
+  esp_err_t err = _response->sendChunk(chunk, len);
+  if (err != ESP_OK) {
+    _failed = true;
+    setWriteError();
+  }
+  return err;
+}
+
+bool ChunkPrinter::flushIfDue()
+{
+  if (!_flushInterval || !_pos || millis() - _lastFlush < _flushInterval)
+    return false;
+
+  flush();
+  return true;
+}
+
 size_t ChunkPrinter::write(uint8_t c)
 {
   esp_err_t err;
 
+  if (_failed)
+    return 0;
+
   // if we're full, send a chunk
   if (_pos == _length)
   {
     _pos = 0;
-    err = _response->sendChunk(_buffer, _length);
+    err = _sendChunk(_buffer, _length);
 
     if (err != ESP_OK)
       return 0;
@@ -29,6 +61,8 @@ size_t ChunkPrinter::write(uint8_t c)
 
   _buffer[_pos] = c;
   _pos++;
+
+  flushIfDue();
   return 1;
 }
 
@@ -36,8 +70,21 @@ size_t ChunkPrinter::write(const uint8_t* buffer, size_t size)
 {
   size_t written = 0;
 
+  if (_failed)
+    return 0;
+
   while (written < size)
   {
+    // nothing buffered and at least a full chunk left: send it straight from the caller's memory
+    if (_pos == 0 && size - written >= _length)
+    {
+      if (_sendChunk((uint8_t*)buffer + written, _length) != ESP_OK)
+        return written;
+
+      written += _length;
+      continue;
+    }
+
     size_t space = _length - _pos;
     size_t blockSize = std::min(space, size - written);
 
@@ -48,33 +95,66 @@ size_t ChunkPrinter::write(const uint8_t* buffer, size_t size)
     {
       _pos = 0;
 
-      if (_response->sendChunk(_buffer, _length) != ESP_OK)
+      if (_sendChunk(_buffer, _length) != ESP_OK)
         return written;
     }
     written += blockSize; // Update if sent correctly.
   }
+
+  flushIfDue();
   return written;
 }
 
 void ChunkPrinter::flush()
 {
+  // nobody is listening anymore, drop it
+  if (_failed)
+    _pos = 0;
+
   if (_pos)
   {
-    _response->sendChunk(_buffer, _pos);
+    _sendChunk(_buffer, _pos);
     _pos = 0;
   }
 }
 
+esp_err_t ChunkPrinter::finish()
+{
+  if (_failed) {
+    _pos = 0;
+    return ESP_FAIL;
+  }
+
+  // the headers are already set, so this goes out with a Content-Length
+  if (!_chunked)
+  {
+    esp_err_t err;
+    if (_response->checkETag((const char*)_buffer, _pos, &err)) {
+      _pos = 0;
+      return err;
+    }
+
+    err = httpd_resp_send(_response->request(), (const char*)_buffer, _pos);
+    if (err == ESP_OK)
+      _response->capture((const char*)_buffer, _pos, true);
+    _pos = 0;
+    return err;
+  }
+
+  flush();
+  return _response->finishChunking();
+}
+
 size_t ChunkPrinter::copyFrom(Stream& stream)
 {
   size_t count = 0;
 
-  while (stream.available())
+  while (!_failed && stream.available())
   {
 
     if (_pos == _length)
     {
-      _response->sendChunk(_buffer, _length);
+      _sendChunk(_buffer, _length);
       _pos = 0;
     }
 
@@ -83,4 +163,4 @@ size_t ChunkPrinter::copyFrom(Stream& stream)
     count += readBytes;
   }
   return count;
-}
\ No newline at end of file
+}
@@ -11,17 +11,38 @@ class ChunkPrinter : public Print
     uint8_t* _buffer;
     size_t _length;
     size_t _pos;
+    bool _chunked;
+    bool _failed; // a send failed, the socket is gone and nothing else goes out
+    uint32_t _flushInterval;
+    unsigned long _lastFlush;
+
+    esp_err_t _sendChunk(uint8_t* chunk, size_t len);
 
   public:
     ChunkPrinter(PsychicResponse* response, uint8_t* buffer, size_t len);
     ~ChunkPrinter();
 
+    // also send a partial chunk if this many ms have passed since the last one (0 = only when full).
+    // only checked on write(), producers that block between writes should call flushIfDue()
+    void setFlushInterval(uint32_t ms) { _flushInterval = ms; }
+
+    // sends what's buffered if the flush interval has passed, true if it did
+    bool flushIfDue();
+
     size_t write(uint8_t c) override;
     size_t write(const uint8_t* buffer, size_t size) override;
 
     size_t copyFrom(Stream& stream);
 
     void flush() override;
+
+    // true once the first chunk went out
+    bool isChunked() const { return _chunked; }
+    // true once a send failed, writes, flush() and finish() do nothing after that
+    bool hasFailed() const { return _failed; }
+
+    // sends a plain response with Content-Length if everything fit in the buffer, otherwise ends the chunked one
+    esp_err_t finish();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,9 +1,15 @@
 #include "PsychicClient.h"
 #include "PsychicHttpServer.h"
+#include "WiFi.h"
 #include <lwip/sockets.h>
+#ifdef PSY_ENABLE_ETHERNET
+  #include "ETH.h"
+#endif
 
 PsychicClient::PsychicClient(httpd_handle_t server, int socket) : _server(server),
                                                                   _socket(socket),
+                                                                  _captured(false),
+                                                                  _interface(INTERFACE_UNKNOWN),
                                                                   _friend(NULL),
                                                                   isNew(false)
 {
@@ -23,6 +29,25 @@ int PsychicClient::socket()
   return _socket;
 }
 
+void PsychicClient::_subscribe(PsychicHandler* handler)
+{
+  for (PsychicHandler* h : _handlers)
+    if (h == handler)
+      return;
+  _handlers.push_back(handler);
+}
+
+void PsychicClient::_unsubscribe(PsychicHandler* handler)
+{
+  for (size_t i = 0; i < _handlers.size(); i++) {
+    if (_handlers[i] == handler) {
+      _handlers[i] = _handlers.back();
+      _handlers.pop_back();
+      return;
+    }
+  }
+}
+
 // I'm not sure this is entirely safe to call.  I was having issues with race conditions when highly loaded using this.
 esp_err_t PsychicClient::close()
 {
@@ -32,62 +57,112 @@ esp_err_t PsychicClient::close()
   return err;
 }
 
-IPAddress PsychicClient::localIP()
+// fills in one end of the socket, peer or local
+static bool readAddress(int socket, bool peer, PsychicSocketAddress& out)
 {
-  IPAddress address(0, 0, 0, 0);
+  memset(&out, 0, sizeof(out));
+
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if ((peer ? getpeername(socket, (struct sockaddr*)&addr, &len) : getsockname(socket, (struct sockaddr*)&addr, &len)) < 0)
+    return false;
+
+  if (addr.ss_family == AF_INET) {
+    struct sockaddr_in* in = (struct sockaddr_in*)&addr;
+    out.v4 = in->sin_addr.s_addr;
+    out.port = ntohs(in->sin_port);
+    return true;
+  }
 
-  char ipstr[INET6_ADDRSTRLEN];
-  struct sockaddr_in6 addr; // esp_http_server uses IPv6 addressing
-  socklen_t addr_size = sizeof(addr);
+#ifdef AF_INET6
+  if (addr.ss_family == AF_INET6) {
+    // esp_http_server listens on IPv6, so IPv4 clients show up as ::ffff:a.b.c.d
+    struct sockaddr_in6* in6 = (struct sockaddr_in6*)&addr;
+    const uint32_t* words = in6->sin6_addr.un.u32_addr;
+    out.port = ntohs(in6->sin6_port);
+    if (words[0] == 0 && words[1] == 0 && words[2] == htonl(0xFFFF))
+      out.v4 = words[3];
+    else {
+      out.ipv6 = true;
+      memcpy(out.v6, &in6->sin6_addr, sizeof(out.v6));
+    }
+    return true;
+  }
+#endif
+
+  return false;
+}
 
-  if (getsockname(_socket, (struct sockaddr*)&addr, &addr_size) < 0) {
+void PsychicClient::capture() const
+{
+  _captured = true;
+  _interface = INTERFACE_UNKNOWN;
+
+  if (!readAddress(_socket, false, _local) || !readAddress(_socket, true, _remote)) {
     ESP_LOGE(PH_TAG, "Error getting client IP");
-    return address;
+    return;
   }
 
-  // Convert to IPv4 string
-  inet_ntop(AF_INET, &addr.sin6_addr.un.u32_addr[3], ipstr, sizeof(ipstr));
-  // ESP_LOGD(PH_TAG, "Client Local IP => %s", ipstr);
-  address.fromString(ipstr);
+  // only IPv4 addresses can be told apart this way
+  if (_local.ipv6 || !_local.v4)
+    return;
+
+  if (_local.v4 == (uint32_t)WiFi.localIP())
+    _interface = INTERFACE_STA;
+  else if (_local.v4 == (uint32_t)WiFi.softAPIP())
+    _interface = INTERFACE_AP;
+#ifdef PSY_ENABLE_ETHERNET
+  else if (_local.v4 == (uint32_t)ETH.localIP())
+    _interface = INTERFACE_ETH;
+#endif
+}
 
-  return address;
+IPAddress PsychicClient::_toIPAddress(const PsychicSocketAddress& address)
+{
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  if (address.ipv6)
+    return IPAddress(IPv6, address.v6);
+#endif
+  return IPAddress(address.v4);
 }
 
-uint16_t PsychicClient::localPort() const
+const PsychicSocketAddress& PsychicClient::localAddress() const
 {
-  struct sockaddr_storage addr;
-  socklen_t len = sizeof addr;
-  getsockname(_socket, (struct sockaddr*)&addr, &len);
-  struct sockaddr_in* s = (struct sockaddr_in*)&addr;
-  return ntohs(s->sin_port);
+  if (!_captured)
+    capture();
+  return _local;
 }
 
-IPAddress PsychicClient::remoteIP()
+const PsychicSocketAddress& PsychicClient::remoteAddress() const
 {
-  IPAddress address(0, 0, 0, 0);
+  if (!_captured)
+    capture();
+  return _remote;
+}
 
-  char ipstr[INET6_ADDRSTRLEN];
-  struct sockaddr_in6 addr; // esp_http_server uses IPv6 addressing
-  socklen_t addr_size = sizeof(addr);
+PsychicInterface PsychicClient::interface() const
+{
+  if (!_captured)
+    capture();
+  return _interface;
+}
 
-  if (getpeername(_socket, (struct sockaddr*)&addr, &addr_size) < 0) {
-    ESP_LOGE(PH_TAG, "Error getting client IP");
-    return address;
-  }
+IPAddress PsychicClient::localIP()
+{
+  return _toIPAddress(localAddress());
+}
 
-  // Convert to IPv4 string
-  inet_ntop(AF_INET, &addr.sin6_addr.un.u32_addr[3], ipstr, sizeof(ipstr));
-  // ESP_LOGD(PH_TAG, "Client Remote IP => %s", ipstr);
-  address.fromString(ipstr);
+uint16_t PsychicClient::localPort() const
+{
+  return localAddress().port;
+}
 
-  return address;
+IPAddress PsychicClient::remoteIP()
+{
+  return _toIPAddress(remoteAddress());
 }
 
 uint16_t PsychicClient::remotePort() const
 {
-  struct sockaddr_storage addr;
-  socklen_t len = sizeof addr;
-  getpeername(_socket, (struct sockaddr*)&addr, &len);
-  struct sockaddr_in* s = (struct sockaddr_in*)&addr;
-  return ntohs(s->sin_port);
+  return remoteAddress().port;
 }
@@ -2,6 +2,25 @@
 #define PsychicClient_h
 
 #include "PsychicCore.h"
+#include <vector>
+
+class PsychicHandler;
+
+// which network a socket came in on, worked out once when it connects
+enum PsychicInterface {
+  INTERFACE_UNKNOWN,
+  INTERFACE_STA,
+  INTERFACE_AP,
+  INTERFACE_ETH
+};
+
+// one end of a socket in binary form
+struct PsychicSocketAddress {
+    bool ipv6;     // false means v4 holds the address, IPv4-mapped IPv6 included
+    uint32_t v4;   // network byte order
+    uint8_t v6[16];
+    uint16_t port; // host byte order
+};
 
 /*
  * PsychicClient :: Generic wrapper around the ESP-IDF socket
@@ -9,11 +28,26 @@
 
 class PsychicClient
 {
+    friend PsychicHandler;
 
   protected:
     httpd_handle_t _server;
     int _socket;
 
+    // handlers tracking this client, so a close only has to visit those
+    std::vector<PsychicHandler*> _handlers;
+
+    void _subscribe(PsychicHandler* handler);
+    void _unsubscribe(PsychicHandler* handler);
+
+    // looked up once instead of on every localIP() / remoteIP(), mutable so the getters stay const
+    mutable bool _captured;
+    mutable PsychicSocketAddress _local;
+    mutable PsychicSocketAddress _remote;
+    mutable PsychicInterface _interface;
+
+    static IPAddress _toIPAddress(const PsychicSocketAddress& address);
+
   public:
     PsychicClient(httpd_handle_t server, int socket);
     ~PsychicClient();
@@ -30,10 +64,21 @@ class PsychicClient
     int socket();
     esp_err_t close();
 
+    const std::vector<PsychicHandler*>& handlers() { return _handlers; }
+    // hands over the subscription list, used by the server when the socket closes
+    void takeHandlers(std::vector<PsychicHandler*>& handlers) { handlers.swap(_handlers); }
+
+    // reads both addresses off the socket and works out the interface, the server calls it on connect
+    void capture() const;
+
     IPAddress localIP();
     uint16_t localPort() const;
     IPAddress remoteIP();
     uint16_t remotePort() const;
+
+    const PsychicSocketAddress& localAddress() const;
+    const PsychicSocketAddress& remoteAddress() const;
+    PsychicInterface interface() const;
 };
 
 #endif
\ No newline at end of file
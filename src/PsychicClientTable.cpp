@@ -0,0 +1,68 @@
+#include "PsychicClientTable.h"
+#include "PsychicClient.h"
+#include <lwip/sockets.h>
+
+int PsychicClientTable::_index(int socket)
+{
+#ifdef LWIP_SOCKET_OFFSET
+  return socket - LWIP_SOCKET_OFFSET;
+#else
+  return socket;
+#endif
+}
+
+void PsychicClientTable::reserve(size_t sockets)
+{
+  if (sockets > _slots.size())
+    _slots.resize(sockets, {NULL, _list.end()});
+}
+
+bool PsychicClientTable::add(PsychicClient* client)
+{
+  int index = _index(client->socket());
+  if (index < 0)
+    return false;
+
+  if ((size_t)index >= _slots.size())
+    reserve(std::max<size_t>(index + 1, CLIENT_TABLE_SIZE));
+
+  Slot& slot = _slots[index];
+  if (slot.client != NULL)
+    return false;
+
+  slot.client = client;
+  slot.position = _list.insert(_list.end(), client);
+  return true;
+}
+
+bool PsychicClientTable::remove(PsychicClient* client)
+{
+  int index = _index(client->socket());
+  if (index < 0 || (size_t)index >= _slots.size())
+    return false;
+
+  // a different object for the same socket isn't ours to remove
+  Slot& slot = _slots[index];
+  if (slot.client != client)
+    return false;
+
+  _list.erase(slot.position);
+  slot.client = NULL;
+  slot.position = _list.end();
+  return true;
+}
+
+PsychicClient* PsychicClientTable::get(int socket) const
+{
+  int index = _index(socket);
+  if (index < 0 || (size_t)index >= _slots.size())
+    return NULL;
+  return _slots[index].client;
+}
+
+void PsychicClientTable::clear()
+{
+  for (Slot& slot : _slots)
+    slot.client = NULL;
+  _list.clear();
+}
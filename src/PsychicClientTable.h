@@ -0,0 +1,57 @@
+#ifndef PsychicClientTable_h
+#define PsychicClientTable_h
+
+#include "PsychicCore.h"
+#include <vector>
+
+// slots a table starts out with, enough for every socket lwip can have open
+#ifndef CLIENT_TABLE_SIZE
+  #ifdef CONFIG_LWIP_MAX_SOCKETS
+    #define CLIENT_TABLE_SIZE CONFIG_LWIP_MAX_SOCKETS
+  #else
+    #define CLIENT_TABLE_SIZE 16
+  #endif
+#endif
+
+/*
+ * PsychicClientTable :: clients indexed by socket number
+ *
+ * Lookups, adds and removes are a single array access instead of a walk of the list.  The list
+ * is still kept (each slot remembers its position in it) so iteration order and getClientList()
+ * stay the same.
+ */
+
+class PsychicClientTable
+{
+  protected:
+    struct Slot {
+        PsychicClient* client;
+        std::list<PsychicClient*>::iterator position;
+    };
+
+    std::vector<Slot> _slots;
+    std::list<PsychicClient*> _list;
+
+    // lwip hands out socket numbers starting at LWIP_SOCKET_OFFSET
+    static int _index(int socket);
+
+  public:
+    // make room for sockets lwip can hand out, the table still grows past that if it has to
+    void reserve(size_t sockets);
+
+    // false if a client with that socket is already in here
+    bool add(PsychicClient* client);
+    bool remove(PsychicClient* client);
+    PsychicClient* get(int socket) const;
+    bool has(int socket) const { return get(socket) != NULL; }
+
+    size_t size() const { return _list.size(); }
+    bool empty() const { return _list.empty(); }
+    void clear();
+
+    const std::list<PsychicClient*>& list() const { return _list; }
+    std::list<PsychicClient*>::const_iterator begin() const { return _list.begin(); }
+    std::list<PsychicClient*>::const_iterator end() const { return _list.end(); }
+};
+
+#endif // PsychicClientTable_h
@@ -7,6 +7,18 @@
   #define FILE_CHUNK_SIZE 8 * 1024
 #endif
 
+#ifndef FILE_PIPELINE_READERS
+  #define FILE_PIPELINE_READERS 2
+#endif
+
+#ifndef FILE_PIPELINE_TASK_STACK_SIZE
+  #define FILE_PIPELINE_TASK_STACK_SIZE (3 * 1024)
+#endif
+
+#ifndef FILE_PIPELINE_TASK_PRIORITY
+  #define FILE_PIPELINE_TASK_PRIORITY 5
+#endif
+
 #ifndef STREAM_CHUNK_SIZE
   #define STREAM_CHUNK_SIZE 1024
 #endif
@@ -32,6 +44,7 @@
 #include <libb64/cencode.h>
 #include <list>
 #include <map>
+#include <type_traits>
 
 #ifdef PSY_DEVMODE
   #include "ArduinoTrace.h"
@@ -53,8 +66,45 @@ class PsychicClient;
 // filter function definition
 typedef std::function<bool(PsychicRequest* request)> PsychicRequestFilterFunction;
 
-// middleware function definition
-typedef std::function<esp_err_t()> PsychicMiddlewareNext;
+class PsychicMiddleware;
+
+// middleware function definition. next is the rest of the chain, call it to carry on: a small cursor
+// that gets copied from layer to layer, so running a chain never allocates.
+class PsychicMiddlewareNext
+{
+  public:
+    typedef esp_err_t (*Finalizer)(void* ctx);
+
+  protected:
+    PsychicMiddleware* const* _middleware; // the layers still to run
+    size_t _count;
+    PsychicRequest* _request;
+    Finalizer _finalizer; // runs once the layers are done
+    void* _ctx;
+
+  public:
+    PsychicMiddlewareNext() : _middleware(NULL), _count(0), _request(NULL), _finalizer(NULL), _ctx(NULL) {}
+    PsychicMiddlewareNext(PsychicMiddleware* const* middleware, size_t count, PsychicRequest* request, Finalizer finalizer, void* ctx);
+
+    // v1 code built next from a lambda, that still works for a named one. it only points at fn, so fn has
+    // to outlive the call, and a temporary won't compile.
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, PsychicMiddlewareNext>::value>::type>
+    PsychicMiddlewareNext(F& fn) : _middleware(NULL), _count(0), _request(NULL), _finalizer(&_call<F>), _ctx((void*)&fn)
+    {
+    }
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, PsychicMiddlewareNext>::value>::type>
+    PsychicMiddlewareNext(F&& fn) = delete;
+
+    esp_err_t operator()() const;
+
+  protected:
+    template <typename F>
+    static esp_err_t _call(void* ctx)
+    {
+      return (*(F*)ctx)();
+    }
+};
+
 typedef std::function<esp_err_t(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next)> PsychicMiddlewareCallback;
 
 // client connect callback
@@ -63,7 +113,13 @@ typedef std::function<void(PsychicClient* client)> PsychicClientCallback;
 // callback definitions
 typedef std::function<esp_err_t(PsychicRequest* request, PsychicResponse* response)> PsychicHttpRequestCallback;
 typedef std::function<esp_err_t(PsychicRequest* request, PsychicResponse* response, JsonVariant& json)> PsychicJsonRequestCallback;
+template <typename T>
+using PsychicJsonBindingCallback = std::function<esp_err_t(PsychicRequest* request, PsychicResponse* response, const T& value)>;
 typedef std::function<esp_err_t(PsychicRequest* request, const String& filename, uint64_t index, uint8_t* data, size_t len, bool final)> PsychicUploadCallback;
+#ifdef ENABLE_COROUTINES
+class PsychicTask;
+typedef std::function<PsychicTask(PsychicRequest* request, PsychicResponse* response)> PsychicCoroutineCallback;
+#endif
 
 struct HTTPHeader {
     String field;
@@ -0,0 +1,602 @@
+#include "PsychicCoroutine.h"
+
+#ifdef ENABLE_COROUTINES
+
+  #include "PsychicRequest.h"
+  #include "PsychicResponse.h"
+  #include "async_worker.h"
+  #include <lwip/sockets.h>
+
+// zero timeout select() on a single socket
+static bool socketReady(int fd, bool write)
+{
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(fd, &set);
+  struct timeval zero = {0, 0};
+  return select(fd + 1, write ? NULL : &set, write ? &set : NULL, NULL, &zero) > 0;
+}
+
+PsychicTask::~PsychicTask()
+{
+  // never started, or a nested task that already finished
+  if (_handle)
+    _handle.destroy();
+}
+
+PsychicTask::handle_type PsychicTask::release()
+{
+  handle_type handle = _handle;
+  _handle = nullptr;
+  return handle;
+}
+
+std::coroutine_handle<> PsychicTask::await_suspend(handle_type parent)
+{
+  // nested tasks run on the same request and come back to the parent when done
+  promise_type& promise = _handle.promise();
+  promise.scheduler = parent.promise().scheduler;
+  promise.root = parent.promise().root;
+  promise.request = parent.promise().request;
+  promise.req = parent.promise().req;
+  promise.continuation = parent;
+
+  return _handle;
+}
+
+std::coroutine_handle<> PsychicTask::FinalAwaiter::await_suspend(handle_type handle) noexcept
+{
+  promise_type& promise = handle.promise();
+  if (promise.continuation)
+    return promise.continuation;
+
+  // the outermost coroutine owns the request, this destroys the frame too
+  promise.scheduler->_finish(handle);
+  return std::noop_coroutine();
+}
+
+PsychicCoroutineScheduler::PsychicCoroutineScheduler() : _count(COROUTINE_TASK_COUNT),
+                                                         _stackSize(COROUTINE_TASK_STACK_SIZE),
+                                                         _priority(COROUTINE_TASK_PRIORITY),
+                                                         _core(tskNO_AFFINITY),
+                                                         _running(false),
+                                                         _stopping(false),
+                                                         _polling(false),
+                                                         _shared(NULL),
+                                                         _inFlight(0),
+                                                         _resumes(0),
+                                                         _lastPoll(0)
+{
+}
+
+PsychicCoroutineScheduler::~PsychicCoroutineScheduler()
+{
+  end();
+}
+
+PsychicCoroutineScheduler* PsychicCoroutineScheduler::setTasks(uint8_t count)
+{
+  _count = count ? count : 1;
+  return this;
+}
+
+PsychicCoroutineScheduler* PsychicCoroutineScheduler::setStackSize(uint32_t size)
+{
+  _stackSize = size;
+  return this;
+}
+
+PsychicCoroutineScheduler* PsychicCoroutineScheduler::setPriority(UBaseType_t priority)
+{
+  _priority = priority;
+  return this;
+}
+
+PsychicCoroutineScheduler* PsychicCoroutineScheduler::setCore(BaseType_t core)
+{
+  _core = core;
+  return this;
+}
+
+esp_err_t PsychicCoroutineScheduler::begin()
+{
+  if (_running)
+    return ESP_OK;
+
+  _shared = (shared_t*)calloc(1, sizeof(shared_t));
+  if (_shared != NULL) {
+    _shared->lock = xSemaphoreCreateMutex();
+    _shared->wake = xSemaphoreCreateCounting(0xFFFF, 0);
+    _shared->stopped = xSemaphoreCreateCounting(_count, 0);
+    _shared->scheduler = this;
+  }
+
+  if (_shared == NULL || _shared->lock == NULL || _shared->wake == NULL || _shared->stopped == NULL) {
+    ESP_LOGE(PH_TAG, "Failed to create the coroutine scheduler");
+    _running = true;
+    end();
+    return ESP_ERR_NO_MEM;
+  }
+
+  _stopping = false;
+  _polling = false;
+  _running = true;
+
+  _tasks.clear();
+  for (uint8_t i = 0; i < _count; i++) {
+    TaskHandle_t handle = NULL;
+    if (xTaskCreatePinnedToCore(PsychicCoroutineScheduler::_task, "coroutine_task", _stackSize, _shared, _priority, &handle, _core) != pdPASS) {
+      ESP_LOGE(PH_TAG, "Failed to start coroutine task %d", i);
+      continue;
+    }
+    _tasks.push_back(handle);
+  }
+
+  // they only leave once we are stopping, so nobody has touched this yet
+  _shared->running = _tasks.size();
+
+  if (_tasks.empty()) {
+    end();
+    return ESP_FAIL;
+  }
+
+  return ESP_OK;
+}
+
+void PsychicCoroutineScheduler::end()
+{
+  if (!_running)
+    return;
+
+  shared_t* shared = _shared;
+  bool ready = shared != NULL && shared->lock != NULL && shared->wake != NULL && shared->stopped != NULL;
+
+  if (ready) {
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+    _stopping = true;
+    shared->stopping = true;
+    xSemaphoreGive(shared->lock);
+
+    for (size_t i = 0; i < _tasks.size(); i++)
+      xSemaphoreGive(shared->wake);
+  }
+
+  // whatever is being resumed right now gets to reach its next co_await
+  bool clean = true;
+  for (size_t i = 0; ready && i < _tasks.size(); i++) {
+    if (xSemaphoreTake(shared->stopped, pdMS_TO_TICKS(COROUTINE_IO_TIMEOUT)) != pdTRUE) {
+      clean = false;
+      break;
+    }
+  }
+  _tasks.clear();
+
+  // cut the futures loose first, a later resolve() then has nobody to tell
+  std::list<std::shared_ptr<PsychicFutureState>> parked;
+  std::deque<PsychicTask::handle_type> queued;
+  std::list<waiter_t> waiting;
+  bool stuck = false;
+  if (ready) {
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+    parked.swap(_parked);
+    queued.swap(_ready);
+    waiting.swap(_waiting);
+
+    // a task still stuck in a coroutine keeps the shared state, the last of them frees it once
+    // the coroutine gives it back. it never touches the scheduler again.
+    stuck = !clean && shared->running > 0;
+    if (stuck)
+      shared->scheduler = NULL;
+    xSemaphoreGive(shared->lock);
+  }
+  for (auto& state : parked) {
+    xSemaphoreTake(state->lock, portMAX_DELAY);
+    PsychicTask::handle_type waiter = state->waiter;
+    state->waiter = nullptr;
+    state->scheduler = nullptr;
+    xSemaphoreGive(state->lock);
+
+    if (waiter)
+      _abandon(waiter);
+  }
+
+  // nothing is left to resume these
+  for (auto& handle : queued)
+    _abandon(handle);
+  for (auto& waiter : waiting)
+    _abandon(waiter.handle);
+
+  _running = false;
+  _shared = NULL;
+
+  if (stuck) {
+    ESP_LOGE(PH_TAG, "Coroutine tasks did not stop within %d ms", COROUTINE_IO_TIMEOUT);
+    return;
+  }
+
+  if (shared == NULL)
+    return;
+
+  // the last task may still be on its way out of _exit()
+  if (shared->lock) {
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+    xSemaphoreGive(shared->lock);
+    vSemaphoreDelete(shared->lock);
+  }
+  if (shared->wake)
+    vSemaphoreDelete(shared->wake);
+  if (shared->stopped)
+    vSemaphoreDelete(shared->stopped);
+  free(shared);
+}
+
+esp_err_t PsychicCoroutineScheduler::start(PsychicTask task, PsychicRequest* request, httpd_req_t* req)
+{
+  // task goes out of scope and takes the frame with it
+  if (!_running || _stopping)
+    return ESP_FAIL;
+
+  PsychicTask::handle_type handle = task.release();
+  PsychicTask::promise_type& promise = handle.promise();
+  promise.scheduler = this;
+  promise.root = &promise;
+  promise.request = request;
+  promise.req = req;
+
+  xSemaphoreTake(_shared->lock, portMAX_DELAY);
+  _inFlight++;
+  xSemaphoreGive(_shared->lock);
+
+  schedule(handle);
+  return ESP_OK;
+}
+
+void PsychicCoroutineScheduler::schedule(PsychicTask::handle_type handle)
+{
+  // resolved after the server stopped
+  if (!_running || _stopping) {
+    _abandon(handle);
+    return;
+  }
+
+  xSemaphoreTake(_shared->lock, portMAX_DELAY);
+  _ready.push_back(handle);
+  xSemaphoreGive(_shared->lock);
+
+  xSemaphoreGive(_shared->wake);
+}
+
+void PsychicCoroutineScheduler::wait(const waiter_t& waiter)
+{
+  // nobody would poll for it anymore
+  if (!_running || _stopping) {
+    _abandon(waiter.handle);
+    return;
+  }
+
+  xSemaphoreTake(_shared->lock, portMAX_DELAY);
+  _waiting.push_back(waiter);
+  xSemaphoreGive(_shared->lock);
+}
+
+void PsychicCoroutineScheduler::park(const std::shared_ptr<PsychicFutureState>& state)
+{
+  // end() won't see it, resolve() then hands it to schedule() which drops it
+  if (!_running || _stopping)
+    return;
+
+  xSemaphoreTake(_shared->lock, portMAX_DELAY);
+  _parked.push_back(state);
+  xSemaphoreGive(_shared->lock);
+}
+
+void PsychicCoroutineScheduler::unpark(PsychicFutureState* state)
+{
+  xSemaphoreTake(_shared->lock, portMAX_DELAY);
+  for (auto it = _parked.begin(); it != _parked.end(); ++it) {
+    if (it->get() == state) {
+      _parked.erase(it);
+      break;
+    }
+  }
+  xSemaphoreGive(_shared->lock);
+
+  schedule(state->waiter);
+}
+
+void PsychicCoroutineScheduler::_poll()
+{
+  std::list<waiter_t> due;
+
+  xSemaphoreTake(_shared->lock, portMAX_DELAY);
+  if (_polling || _waiting.empty()) {
+    xSemaphoreGive(_shared->lock);
+    return;
+  }
+  _polling = true;
+  _lastPoll = millis();
+
+  fd_set readable, writable;
+  FD_ZERO(&readable);
+  FD_ZERO(&writable);
+  int maxfd = -1;
+  for (auto& waiter : _waiting) {
+    if (waiter.fd < 0)
+      continue;
+    FD_SET(waiter.fd, waiter.write ? &writable : &readable);
+    maxfd = std::max(maxfd, waiter.fd);
+  }
+
+  if (maxfd >= 0) {
+    struct timeval zero = {0, 0};
+    if (select(maxfd + 1, &readable, &writable, NULL, &zero) <= 0) {
+      FD_ZERO(&readable);
+      FD_ZERO(&writable);
+    }
+  }
+
+  // pull out everything that is ready or out of time
+  unsigned long now = millis();
+  for (auto it = _waiting.begin(); it != _waiting.end();) {
+    bool ready = it->fd >= 0 && FD_ISSET(it->fd, it->write ? &writable : &readable);
+    bool expired = (long)(now - it->deadline) >= 0;
+    if (ready || expired) {
+      auto next = std::next(it);
+      due.splice(due.end(), _waiting, it);
+      it = next;
+    } else
+      ++it;
+  }
+  xSemaphoreGive(_shared->lock);
+
+  // socket io happens outside the lock
+  for (auto& waiter : due) {
+    bool expired = (long)(now - waiter.deadline) >= 0;
+    bool ready = waiter.fd >= 0 && FD_ISSET(waiter.fd, waiter.write ? &writable : &readable);
+
+    // eg. a partial tls record, keep waiting for the rest
+    if (ready && waiter.attempt != nullptr && !waiter.attempt(waiter.ctx) && !expired) {
+      wait(waiter);
+      continue;
+    }
+
+    if (waiter.status != nullptr)
+      *waiter.status = (ready || waiter.fd < 0) ? ESP_OK : ESP_ERR_TIMEOUT;
+    schedule(waiter.handle);
+  }
+
+  xSemaphoreTake(_shared->lock, portMAX_DELAY);
+  _polling = false;
+  xSemaphoreGive(_shared->lock);
+}
+
+void PsychicCoroutineScheduler::_finish(PsychicTask::handle_type handle)
+{
+  PsychicTask::promise_type& promise = handle.promise();
+  PsychicRequest* request = promise.request;
+  httpd_req_t* req = promise.req;
+
+  // locals in the coroutine may still point at the request
+  handle.destroy();
+  delete request;
+
+  // tell the server it can have the socket back
+  if (httpd_req_async_handler_complete(req) != ESP_OK)
+    ESP_LOGE(PH_TAG, "Failed to complete coroutine request");
+
+  shared_t* shared = _shared;
+  if (shared != NULL)
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+  _inFlight--;
+  if (shared != NULL)
+    xSemaphoreGive(shared->lock);
+}
+
+void PsychicCoroutineScheduler::_abandon(PsychicTask::handle_type handle)
+{
+  // dropping the outermost frame takes any nested ones with it
+  PsychicTask::promise_type* root = handle.promise().root;
+  ESP_LOGW(PH_TAG, "Dropping coroutine request %s", root->req->uri);
+  _finish(PsychicTask::handle_type::from_promise(*root));
+}
+
+// called with shared->lock held, releases it. frees the shared state if we were the last straggler.
+void PsychicCoroutineScheduler::_exit(shared_t* shared)
+{
+  shared->running--;
+  xSemaphoreGive(shared->stopped);
+
+  bool last = shared->scheduler == NULL && shared->running == 0;
+  xSemaphoreGive(shared->lock);
+
+  if (last) {
+    vSemaphoreDelete(shared->lock);
+    vSemaphoreDelete(shared->wake);
+    vSemaphoreDelete(shared->stopped);
+    free(shared);
+  }
+}
+
+void PsychicCoroutineScheduler::_task(void* arg)
+{
+  shared_t* shared = (shared_t*)arg;
+  ESP_LOGI(PH_TAG, "starting coroutine task");
+
+  while (true) {
+    // only wake up on our own while something waits on a socket or a timer
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+    PsychicCoroutineScheduler* self = shared->scheduler;
+    if (self == NULL || shared->stopping)
+      break;
+    TickType_t wait = self->_waiting.empty() ? portMAX_DELAY : pdMS_TO_TICKS(COROUTINE_POLL_INTERVAL);
+    xSemaphoreGive(shared->lock);
+
+    bool woken = xSemaphoreTake(shared->wake, wait) == pdTRUE;
+
+    PsychicTask::handle_type handle = nullptr;
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+    self = shared->scheduler;
+    if (self == NULL || shared->stopping)
+      break;
+    if (woken && !self->_ready.empty()) {
+      handle = self->_ready.front();
+      self->_ready.pop_front();
+      self->_resumes++;
+    }
+    xSemaphoreGive(shared->lock);
+
+    // runs until the next co_await, or to the end
+    if (handle) {
+      handle.resume();
+
+      // end() may have given up on us while we were in there
+      xSemaphoreTake(shared->lock, portMAX_DELAY);
+      self = shared->scheduler;
+      if (self == NULL || shared->stopping)
+        break;
+      xSemaphoreGive(shared->lock);
+    }
+
+    if (!woken || millis() - self->_lastPoll >= COROUTINE_POLL_INTERVAL)
+      self->_poll();
+  }
+
+  // still holding shared->lock
+  ESP_LOGW(PH_TAG, "coroutine task stopped");
+  _exit(shared);
+  vTaskDelete(NULL);
+}
+
+PsychicCoroutineHandler::PsychicCoroutineHandler(PsychicCoroutineCallback fn) : PsychicWebHandler(),
+                                                                                 _onCoroutine(fn)
+{
+}
+
+PsychicCoroutineHandler* PsychicCoroutineHandler::onRequest(PsychicCoroutineCallback fn)
+{
+  _onCoroutine = fn;
+  return this;
+}
+
+esp_err_t PsychicCoroutineHandler::handleRequest(PsychicRequest* request, PsychicResponse* response)
+{
+  // lookup our client
+  PsychicClient* client = checkForNewClient(request->client());
+  if (client->isNew)
+    openCallback(client);
+
+  if (_onCoroutine == nullptr)
+    return response->send(500, "text/html", "No handler registered.");
+
+  PsychicCoroutineScheduler* scheduler = request->server()->coroutines();
+  if (!scheduler->isRunning())
+    return response->send(503, "text/html", "Coroutine scheduler not running.");
+
+  // must create a copy of the request that we own
+  httpd_req_t* copy = NULL;
+  esp_err_t err = httpd_req_async_handler_begin(request->request(), &copy);
+  if (err != ESP_OK) {
+    ESP_LOGE(PH_TAG, "Unable to start coroutine request (%s)", esp_err_to_name(err));
+    return response->send(500, "text/html", "Unable to start request.");
+  }
+
+  // the coroutine outlives this call, so it gets its own request on the copy.  keep any rewrite.
+  PsychicRequest* owned = new PsychicRequest(request->server(), copy);
+  owned->_setUri(request->uri().c_str());
+  owned->setEndpoint(request->endpoint());
+
+  // nothing runs yet, the frame is only created here and started on the scheduler
+  err = scheduler->start(_onCoroutine(owned, owned->response()), owned, copy);
+  if (err != ESP_OK) {
+    owned->response()->send(503, "text/html", "Coroutine scheduler not running.");
+    delete owned;
+    httpd_req_async_handler_complete(copy);
+  }
+
+  return ESP_OK;
+}
+
+void PsychicSleep::await_suspend(PsychicTask::handle_type handle)
+{
+  handle.promise().scheduler->wait({handle, -1, false, millis() + _ms, nullptr, nullptr, nullptr});
+}
+
+PsychicRecv::PsychicRecv(PsychicRequest* request, char* buf, size_t len) : _req(request->request()),
+                                                                          _buf(buf),
+                                                                          _len(len),
+                                                                          _result(HTTPD_SOCK_ERR_TIMEOUT)
+{
+}
+
+bool PsychicRecv::_attempt(void* ctx)
+{
+  PsychicRecv* self = (PsychicRecv*)ctx;
+  int fd = httpd_req_to_sockfd(self->_req);
+
+  // a 1ms receive timeout makes httpd_req_recv() effectively non blocking, while it still
+  // hands out whatever httpd buffered along with the headers first
+  struct timeval saved;
+  socklen_t size = sizeof(saved);
+  bool restore = getsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &saved, &size) == 0;
+  struct timeval quick = {0, 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &quick, sizeof(quick));
+
+  self->_result = httpd_req_recv(self->_req, self->_buf, self->_len);
+
+  if (restore)
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &saved, sizeof(saved));
+
+  return self->_result != HTTPD_SOCK_ERR_TIMEOUT;
+}
+
+void PsychicRecv::await_suspend(PsychicTask::handle_type handle)
+{
+  int fd = httpd_req_to_sockfd(_req);
+  handle.promise().scheduler->wait({handle, fd, false, millis() + COROUTINE_IO_TIMEOUT, PsychicRecv::_attempt, this, nullptr});
+}
+
+PsychicWritable::PsychicWritable(PsychicRequest* request) : _req(request->request()),
+                                                           _status(ESP_OK)
+{
+}
+
+bool PsychicWritable::await_ready()
+{
+  return socketReady(httpd_req_to_sockfd(_req), true);
+}
+
+void PsychicWritable::await_suspend(PsychicTask::handle_type handle)
+{
+  int fd = httpd_req_to_sockfd(_req);
+  handle.promise().scheduler->wait({handle, fd, true, millis() + COROUTINE_IO_TIMEOUT, nullptr, nullptr, &_status});
+}
+
+PsychicSendChunk::PsychicSendChunk(PsychicResponse* response, uint8_t* data, size_t len) : _response(response),
+                                                                                          _data(data),
+                                                                                          _len(len),
+                                                                                          _status(ESP_OK),
+                                                                                          _result(ESP_OK)
+{
+}
+
+bool PsychicSendChunk::_attempt(void* ctx)
+{
+  PsychicSendChunk* self = (PsychicSendChunk*)ctx;
+  self->_result = self->_response->sendChunk(self->_data, self->_len);
+  return true;
+}
+
+bool PsychicSendChunk::await_ready()
+{
+  if (!socketReady(httpd_req_to_sockfd(_response->request()), true))
+    return false;
+  return _attempt(this);
+}
+
+void PsychicSendChunk::await_suspend(PsychicTask::handle_type handle)
+{
+  int fd = httpd_req_to_sockfd(_response->request());
+  handle.promise().scheduler->wait({handle, fd, true, millis() + COROUTINE_IO_TIMEOUT, PsychicSendChunk::_attempt, this, &_status});
+}
+
+#endif // ENABLE_COROUTINES
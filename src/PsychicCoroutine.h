@@ -0,0 +1,366 @@
+#ifndef PsychicCoroutine_h
+#define PsychicCoroutine_h
+
+#ifdef ENABLE_COROUTINES
+
+  #if !defined(__cpp_impl_coroutine)
+    #error "ENABLE_COROUTINES needs a C++20 compiler, build with -std=gnu++20"
+  #endif
+
+  #include "PsychicCore.h"
+  #include "PsychicWebHandler.h"
+  #include "freertos/FreeRTOS.h"
+  #include "freertos/semphr.h"
+  #include "freertos/task.h"
+  #include <coroutine>
+  #include <deque>
+  #include <memory>
+  #include <vector>
+
+  // how many tasks resume coroutines, they are all shared by every in-flight coroutine request
+  #ifndef COROUTINE_TASK_COUNT
+    #define COROUTINE_TASK_COUNT 1
+  #endif
+
+  #ifndef COROUTINE_TASK_STACK_SIZE
+    #define COROUTINE_TASK_STACK_SIZE (6 * 1024)
+  #endif
+
+  #ifndef COROUTINE_TASK_PRIORITY
+    #define COROUTINE_TASK_PRIORITY 5
+  #endif
+
+  // how often sockets and timers are checked while something is waiting on them, in ms
+  #ifndef COROUTINE_POLL_INTERVAL
+    #define COROUTINE_POLL_INTERVAL 5
+  #endif
+
+  // how long a co_await on the socket waits before giving up, in ms
+  #ifndef COROUTINE_IO_TIMEOUT
+    #define COROUTINE_IO_TIMEOUT 5000
+  #endif
+
+class PsychicCoroutineScheduler;
+
+/*
+ * PsychicTask :: the return type of a coroutine handler, eg.
+ *
+ *   PsychicTask handler(PsychicRequest* request, PsychicResponse* response)
+ *   {
+ *     co_await PsychicSleep(100);
+ *     co_return response->send("done");
+ *   }
+ *
+ * A PsychicTask can also co_await another PsychicTask, which runs on the same request and
+ * returns its co_return value.
+ */
+
+class PsychicTask
+{
+  public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    // cleans up the request once the outermost coroutine is done, or resumes whoever awaited us
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(handle_type handle) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+        PsychicCoroutineScheduler* scheduler = nullptr;
+        promise_type* root = nullptr;
+        PsychicRequest* request = nullptr;
+        httpd_req_t* req = nullptr;
+        std::coroutine_handle<> continuation = nullptr;
+        esp_err_t result = ESP_OK;
+
+        PsychicTask get_return_object() { return PsychicTask(handle_type::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_value(esp_err_t err) { result = err; }
+        void unhandled_exception() { abort(); }
+    };
+
+  protected:
+    handle_type _handle;
+
+    explicit PsychicTask(handle_type handle) : _handle(handle) {}
+
+  public:
+    PsychicTask(PsychicTask&& other) noexcept : _handle(other._handle) { other._handle = nullptr; }
+    PsychicTask(const PsychicTask&) = delete;
+    PsychicTask& operator=(const PsychicTask&) = delete;
+    ~PsychicTask();
+
+    // hands the coroutine over, the scheduler owns it from here on
+    handle_type release();
+
+    // co_await on a nested task
+    bool await_ready() { return !_handle || _handle.done(); }
+    std::coroutine_handle<> await_suspend(handle_type parent);
+    esp_err_t await_resume() { return _handle ? _handle.promise().result : ESP_FAIL; }
+};
+
+// the part of a PsychicFuture the scheduler needs, so end() can drop the coroutines parked on one
+struct PsychicFutureState {
+    SemaphoreHandle_t lock;
+    bool ready = false;
+    PsychicTask::handle_type waiter = nullptr;
+    PsychicCoroutineScheduler* scheduler = nullptr; // cleared by end(), resolve() then has nobody to tell
+
+    PsychicFutureState() { lock = xSemaphoreCreateMutex(); }
+    virtual ~PsychicFutureState() { vSemaphoreDelete(lock); }
+};
+
+/*
+ * PsychicCoroutineScheduler :: resumes coroutine handlers on a few shared tasks
+ *
+ * A suspended coroutine only costs its frame, so many slow requests can be in flight on one or
+ * two tasks.  Awaits on sockets and timers are checked with select() every COROUTINE_POLL_INTERVAL
+ * ms while anything is waiting.  Every server owns one, configure it before server.begin().
+ */
+
+class PsychicCoroutineScheduler
+{
+    friend PsychicTask;
+
+  public:
+    typedef struct {
+        PsychicTask::handle_type handle;
+        int fd;                     // -1 to only wait for the deadline
+        bool write;                 // wait for the socket to be writable instead of readable
+        unsigned long deadline;     // millis()
+        bool (*attempt)(void* ctx); // called once the socket is ready, false to keep waiting
+        void* ctx;
+        esp_err_t* status; // ESP_OK, or ESP_ERR_TIMEOUT if the deadline passed first
+    } waiter_t;
+
+  protected:
+    // what the tasks hold on to, it outlives the scheduler's run if end() gives up on a task stuck
+    // in a coroutine. the last of those stragglers frees it.
+    struct shared_t {
+        SemaphoreHandle_t lock;
+        SemaphoreHandle_t wake;
+        SemaphoreHandle_t stopped;
+        PsychicCoroutineScheduler* scheduler; // NULL once end() let go
+        bool stopping;
+        uint8_t running;
+    };
+
+    uint8_t _count;
+    uint32_t _stackSize;
+    UBaseType_t _priority;
+    BaseType_t _core;
+
+    std::vector<TaskHandle_t> _tasks;
+    bool _running;
+    bool _stopping;
+    bool _polling;
+
+    std::deque<PsychicTask::handle_type> _ready;
+    std::list<waiter_t> _waiting;
+    std::list<std::shared_ptr<PsychicFutureState>> _parked; // waiting on a PsychicFuture
+    shared_t* _shared;
+
+    size_t _inFlight;
+    uint32_t _resumes;
+    unsigned long _lastPoll;
+
+    void _poll();
+    void _finish(PsychicTask::handle_type handle);
+    void _abandon(PsychicTask::handle_type handle);
+    static void _task(void* arg);
+    static void _exit(shared_t* shared);
+
+  public:
+    PsychicCoroutineScheduler();
+    ~PsychicCoroutineScheduler();
+
+    // all of these must be set before begin()
+    PsychicCoroutineScheduler* setTasks(uint8_t count);
+    PsychicCoroutineScheduler* setStackSize(uint32_t size);
+    PsychicCoroutineScheduler* setPriority(UBaseType_t priority);
+    PsychicCoroutineScheduler* setCore(BaseType_t core); // tskNO_AFFINITY for any
+
+    esp_err_t begin();
+    // in-flight coroutines are dropped, their sockets close with the server
+    void end();
+    bool isRunning() { return _running; }
+
+    size_t inFlight() { return _inFlight; }
+    uint32_t resumes() { return _resumes; }
+
+    // takes over request (built on an async copy of req) and runs task on it
+    esp_err_t start(PsychicTask task, PsychicRequest* request, httpd_req_t* req);
+
+    // queue a suspended coroutine to be resumed, safe from any task
+    void schedule(PsychicTask::handle_type handle);
+
+    // park a suspended coroutine until its socket is ready or the deadline passes, used by the awaitables
+    void wait(const waiter_t& waiter);
+
+    // park state's waiter until it is resolved, and hand it back for scheduling. both with state->lock held.
+    void park(const std::shared_ptr<PsychicFutureState>& state);
+    void unpark(PsychicFutureState* state);
+};
+
+/*
+ * HANDLER :: runs a PsychicCoroutineCallback on the server's coroutine scheduler.
+ *
+ * The body is not loaded up front, read it with co_await PsychicRecv() instead.
+ */
+
+class PsychicCoroutineHandler : public PsychicWebHandler
+{
+  protected:
+    PsychicCoroutineCallback _onCoroutine;
+
+  public:
+    PsychicCoroutineHandler(PsychicCoroutineCallback fn = nullptr);
+
+    PsychicCoroutineHandler* onRequest(PsychicCoroutineCallback fn);
+    virtual esp_err_t handleRequest(PsychicRequest* request, PsychicResponse* response) override;
+};
+
+// co_await PsychicSleep(ms) - suspend without holding a task
+class PsychicSleep
+{
+  protected:
+    uint32_t _ms;
+
+  public:
+    explicit PsychicSleep(uint32_t ms) : _ms(ms) {}
+
+    bool await_ready() { return _ms == 0; }
+    void await_suspend(PsychicTask::handle_type handle);
+    void await_resume() {}
+};
+
+// int len = co_await PsychicRecv(request, buf, len) - same return values as httpd_req_recv(), 0 once the body is done
+class PsychicRecv
+{
+  protected:
+    httpd_req_t* _req;
+    char* _buf;
+    size_t _len;
+    int _result;
+
+    static bool _attempt(void* ctx);
+
+  public:
+    PsychicRecv(PsychicRequest* request, char* buf, size_t len);
+
+    bool await_ready() { return _attempt(this); }
+    void await_suspend(PsychicTask::handle_type handle);
+    int await_resume() { return _result; }
+};
+
+// esp_err_t err = co_await PsychicWritable(request) - wait until a send won't block on a full socket
+class PsychicWritable
+{
+  protected:
+    httpd_req_t* _req;
+    esp_err_t _status;
+
+  public:
+    PsychicWritable(PsychicRequest* request);
+
+    bool await_ready();
+    void await_suspend(PsychicTask::handle_type handle);
+    esp_err_t await_resume() { return _status; }
+};
+
+// esp_err_t err = co_await PsychicSendChunk(response, data, len) - sendChunk() once the socket can take it
+class PsychicSendChunk
+{
+  protected:
+    PsychicResponse* _response;
+    uint8_t* _data;
+    size_t _len;
+    esp_err_t _status;
+    esp_err_t _result;
+
+    static bool _attempt(void* ctx);
+
+  public:
+    PsychicSendChunk(PsychicResponse* response, uint8_t* data, size_t len);
+
+    bool await_ready();
+    void await_suspend(PsychicTask::handle_type handle);
+    esp_err_t await_resume() { return _status == ESP_OK ? _result : _status; }
+};
+
+/*
+ * PsychicFuture :: a value some other task fills in later, co_await it from a coroutine handler.
+ *
+ *   PsychicFuture<float> reading;
+ *   xQueueSend(sensorQueue, &reading, 0); // the sensor task calls reading.resolve(value)
+ *   float value = co_await reading;
+ *
+ * Copies share the same value, so it can be handed to other tasks by value.
+ */
+
+template <typename T>
+class PsychicFuture
+{
+  protected:
+    struct State : PsychicFutureState {
+        T value{};
+    };
+
+    std::shared_ptr<State> _state;
+
+  public:
+    PsychicFuture() : _state(std::make_shared<State>()) {}
+
+    bool isReady()
+    {
+      xSemaphoreTake(_state->lock, portMAX_DELAY);
+      bool ready = _state->ready;
+      xSemaphoreGive(_state->lock);
+      return ready;
+    }
+
+    // safe from any task, only the first call counts
+    void resolve(const T& value)
+    {
+      xSemaphoreTake(_state->lock, portMAX_DELAY);
+      if (_state->ready) {
+        xSemaphoreGive(_state->lock);
+        return;
+      }
+      _state->value = value;
+      _state->ready = true;
+
+      // still under the lock, so the scheduler can't go away underneath us
+      if (_state->waiter && _state->scheduler)
+        _state->scheduler->unpark(_state.get());
+      _state->waiter = nullptr;
+      xSemaphoreGive(_state->lock);
+    }
+
+    bool await_ready() { return isReady(); }
+
+    bool await_suspend(PsychicTask::handle_type handle)
+    {
+      xSemaphoreTake(_state->lock, portMAX_DELAY);
+      // resolved while we were getting here, carry on
+      if (_state->ready) {
+        xSemaphoreGive(_state->lock);
+        return false;
+      }
+      _state->waiter = handle;
+      _state->scheduler = handle.promise().scheduler;
+      _state->scheduler->park(_state);
+      xSemaphoreGive(_state->lock);
+      return true;
+    }
+
+    T await_resume() { return _state->value; }
+};
+
+#endif // ENABLE_COROUTINES
+
+#endif // PsychicCoroutine_h
@@ -0,0 +1,122 @@
+#include "PsychicDeferredRequest.h"
+#include "PsychicRequest.h"
+#include "PsychicResponse.h"
+#include "async_worker.h"
+
+PsychicDeferredRequest::PsychicDeferredRequest(PsychicHttpServer* server, httpd_req_t* req) : _server(server),
+                                                                                              _req(req),
+                                                                                              _timer(nullptr),
+                                                                                              _completed(false),
+                                                                                              _refs(1)
+{
+}
+
+PsychicDeferredRequest::~PsychicDeferredRequest()
+{
+  if (_timer != nullptr)
+    esp_timer_delete(_timer);
+}
+
+esp_err_t PsychicDeferredRequest::_startTimer(uint32_t timeout_ms)
+{
+  esp_timer_create_args_t args = {};
+  args.callback = PsychicDeferredRequest::_timeoutCallback;
+  args.arg = this;
+  args.name = "psychic_defer";
+
+  esp_err_t err = esp_timer_create(&args, &_timer);
+  if (err != ESP_OK)
+    return err;
+
+  // the timer holds its own reference until it fires or is stopped
+  _refs++;
+  err = esp_timer_start_once(_timer, (uint64_t)timeout_ms * 1000);
+  if (err != ESP_OK)
+    _refs--;
+
+  return err;
+}
+
+void PsychicDeferredRequest::_complete()
+{
+  // tell the server it can have the socket back
+  if (httpd_req_async_handler_complete(_req) != ESP_OK)
+    ESP_LOGE(PH_TAG, "Failed to complete deferred request");
+  _req = nullptr;
+
+  // if the timer never fired, its reference is ours to drop
+  if (_timer != nullptr && esp_timer_stop(_timer) == ESP_OK)
+    _release();
+}
+
+void PsychicDeferredRequest::_release()
+{
+  if (--_refs == 0)
+    delete this;
+}
+
+void PsychicDeferredRequest::_timeoutCallback(void* arg)
+{
+  PsychicDeferredRequest* self = (PsychicDeferredRequest*)arg;
+
+  // somebody already answered
+  if (!self->_claim()) {
+    self->_release();
+    return;
+  }
+
+  // don't do socket io on the timer task
+  if (httpd_queue_work(self->_server->server, PsychicDeferredRequest::_timeoutWork, self) == ESP_OK)
+    return;
+
+  // the queue is full, give it back to the owner for a bit and try again
+  self->_completed = false;
+  if (esp_timer_start_once(self->_timer, (uint64_t)DEFERRED_RETRY_INTERVAL * 1000) != ESP_OK) {
+    ESP_LOGE(PH_TAG, "Deferred request timed out, waiting for send()");
+    self->_release();
+  }
+}
+
+void PsychicDeferredRequest::_timeoutWork(void* arg)
+{
+  PsychicDeferredRequest* self = (PsychicDeferredRequest*)arg;
+
+  ESP_LOGW(PH_TAG, "Deferred request %s timed out", self->_req->uri);
+  httpd_resp_set_status(self->_req, "504 Gateway Timeout");
+  httpd_resp_set_type(self->_req, "text/html");
+  httpd_resp_sendstr(self->_req, "Request timed out.");
+
+  httpd_req_async_handler_complete(self->_req);
+  self->_req = nullptr;
+
+  self->_release();
+}
+
+esp_err_t PsychicDeferredRequest::send(PsychicHttpRequestCallback fn)
+{
+  esp_err_t err = ESP_ERR_TIMEOUT;
+
+  if (_claim()) {
+    // scoped so the request is gone before we hand the socket back
+    {
+      PsychicRequest request(_server, _req);
+      err = fn(&request, request.response());
+    }
+    _complete();
+  }
+
+  _release();
+  return err;
+}
+
+esp_err_t PsychicDeferredRequest::send(int code, const char* contentType, const char* content)
+{
+  return send(code, contentType, (const uint8_t*)content, strlen(content));
+}
+
+esp_err_t PsychicDeferredRequest::send(int code, const char* contentType, const uint8_t* content, size_t len)
+{
+  return send([code, contentType, content, len](PsychicRequest* request, PsychicResponse* response) {
+    return response->send(code, contentType, content, len);
+  });
+}
@@ -0,0 +1,56 @@
+#ifndef PsychicDeferredRequest_h
+#define PsychicDeferredRequest_h
+
+#include "PsychicCore.h"
+#include "esp_timer.h"
+#include <atomic>
+
+// how soon the timeout tries again when the httpd work queue is full, in ms
+#ifndef DEFERRED_RETRY_INTERVAL
+  #define DEFERRED_RETRY_INTERVAL 10
+#endif
+
+/*
+ * PsychicDeferredRequest :: a request parked with httpd_req_async_handler_begin()
+ *
+ * Returned by PsychicRequest::defer().  The handler returns straight away and any task can
+ * finish the response later with send().  If a timeout was given and nobody answers in time,
+ * the client gets a 504 on the httpd task instead.
+ *
+ * send() must be called exactly once, even after a timeout, as it is what frees the handle.
+ */
+
+class PsychicDeferredRequest
+{
+    friend PsychicRequest;
+
+  protected:
+    PsychicHttpServer* _server;
+    httpd_req_t* _req;
+    esp_timer_handle_t _timer;
+    std::atomic<bool> _completed;
+    std::atomic<uint8_t> _refs;
+
+    PsychicDeferredRequest(PsychicHttpServer* server, httpd_req_t* req);
+    ~PsychicDeferredRequest();
+
+    bool _claim() { return !_completed.exchange(true); }
+    void _complete();
+    void _release();
+
+    esp_err_t _startTimer(uint32_t timeout_ms);
+    static void _timeoutCallback(void* arg);
+    static void _timeoutWork(void* arg);
+
+  public:
+    // true once a response went out, either from send() or from the timeout
+    bool isCompleted() const { return _completed; }
+
+    // builds a full PsychicRequest/PsychicResponse on the calling task and hands it to fn
+    esp_err_t send(PsychicHttpRequestCallback fn);
+
+    esp_err_t send(int code, const char* contentType, const char* content);
+    esp_err_t send(int code, const char* contentType, const uint8_t* content, size_t len);
+};
+
+#endif // PsychicDeferredRequest_h
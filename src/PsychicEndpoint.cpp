@@ -43,15 +43,10 @@ String PsychicEndpoint::uri()
 esp_err_t PsychicEndpoint::requestCallback(httpd_req_t* req)
 {
 #ifdef ENABLE_ASYNC
-  if (is_on_async_worker_thread() == false) {
-    if (submit_async_req(req, PsychicEndpoint::requestCallback) == ESP_OK) {
-      return ESP_OK;
-    } else {
-      httpd_resp_set_status(req, "503 Busy");
-      httpd_resp_sendstr(req, "No workers available. Server busy.</div>");
-      return ESP_OK;
-    }
-  }
+  PsychicEndpoint* endpoint = (PsychicEndpoint*)req->user_ctx;
+  PsychicWorkerPool* workers = endpoint->_server->workers();
+  if (endpoint->_offload && workers->isWorkerThread() == false)
+    return endpoint->offloadRequest(req, PsychicEndpoint::requestCallback);
 #endif
 
   PsychicEndpoint* self = (PsychicEndpoint*)req->user_ctx;
@@ -97,6 +92,38 @@ bool PsychicEndpoint::matches(const char* uri)
   }
 }
 
+PsychicEndpoint* PsychicEndpoint::setOffload(bool offload)
+{
+  _offload = offload;
+  return this;
+}
+
+PsychicEndpoint* PsychicEndpoint::setPriority(PsychicPriority priority)
+{
+  _priority = priority;
+  return this;
+}
+
+PsychicEndpoint* PsychicEndpoint::setAdmission(uint32_t target_ms, size_t max_queued)
+{
+  _latencyTarget = target_ms;
+  _queueLimit = max_queued;
+  return this;
+}
+
+bool PsychicEndpoint::submitRequest(httpd_req_t* req, httpd_req_handler_t handler)
+{
+  PsychicWorkerPool* workers = _server->workers();
+  return workers->admit(_latencyTarget, _queueLimit) && workers->submit(req, handler, _priority) == ESP_OK;
+}
+
+esp_err_t PsychicEndpoint::offloadRequest(httpd_req_t* req, httpd_req_handler_t handler)
+{
+  if (!submitRequest(req, handler))
+    _server->workers()->sendBusy(req);
+  return ESP_OK;
+}
+
 httpd_uri_match_func_t PsychicEndpoint::getURIMatchFunction()
 {
   return _uri_match_fn;
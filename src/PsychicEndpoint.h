@@ -2,6 +2,7 @@
 #define PsychicEndpoint_h
 
 #include "PsychicCore.h"
+#include "PsychicWorkerPool.h"
 
 class PsychicHandler;
 class PsychicMiddleware;
@@ -20,6 +21,10 @@ class PsychicEndpoint
     int _method;
     PsychicHandler* _handler;
     httpd_uri_match_func_t _uri_match_fn = nullptr; // use this change the endpoint matching function.
+    bool _offload = false;                          // run on the worker pool instead of the server task
+    PsychicPriority _priority = PRIORITY_NORMAL;
+    uint32_t _latencyTarget = 0; // admission targets for offloaded requests, 0 is off
+    size_t _queueLimit = 0;
 
   public:
     PsychicEndpoint();
@@ -33,6 +38,19 @@ class PsychicEndpoint
 
     bool matches(const char* uri);
 
+    // slow handlers can be moved to the worker pool (ENABLE_ASYNC), everything else runs inline
+    PsychicEndpoint* setOffload(bool offload = true);
+    bool offload() { return _offload; }
+    PsychicEndpoint* setPriority(PsychicPriority priority);
+    PsychicPriority priority() { return _priority; }
+    // turn offloaded requests away early with a 503 once the workers can't meet these targets
+    PsychicEndpoint* setAdmission(uint32_t target_ms, size_t max_queued = 0);
+
+    // queue the request on the worker pool, false if it wasn't admitted and still needs an answer
+    bool submitRequest(httpd_req_t* req, httpd_req_handler_t handler);
+    // queue the request on the worker pool, or answer 503 if it isn't admitted
+    esp_err_t offloadRequest(httpd_req_t* req, httpd_req_handler_t handler);
+
     // called to process this endpoint with its middleware chain
     esp_err_t process(PsychicRequest* request);
 
@@ -1,7 +1,99 @@
 #include "PsychicFileResponse.h"
 #include "PsychicRequest.h"
 #include "PsychicResponse.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include <http_status.h>
+#include <lwip/sockets.h>
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+} file_pipeline_chunk_t;
+
+typedef struct {
+    TaskHandle_t task;
+    fs::File* file;
+    size_t chunkSize;
+    QueueHandle_t empty;
+    QueueHandle_t full;
+    SemaphoreHandle_t done;
+} file_pipeline_t;
+
+// reads the file into whichever buffer the sender hands back, until EOF or a NULL buffer
+static void file_pipeline_reader_task(void* arg)
+{
+  file_pipeline_t* pipe = (file_pipeline_t*)arg;
+  file_pipeline_chunk_t chunk;
+
+  // readers live forever, each response just wakes one up
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while (xQueueReceive(pipe->empty, &chunk, portMAX_DELAY) == pdTRUE) {
+      // sender gave up, stop reading.
+      if (chunk.data == NULL)
+        break;
+
+      chunk.len = pipe->file->read(chunk.data, pipe->chunkSize);
+      xQueueSend(pipe->full, &chunk, portMAX_DELAY);
+
+      // zero length chunk signals EOF to the sender
+      if (chunk.len == 0)
+        break;
+    }
+
+    xSemaphoreGive(pipe->done);
+  }
+}
+
+// start the reader tasks, returns a queue of the idle ones or NULL if none could be started
+static QueueHandle_t file_pipeline_start()
+{
+  QueueHandle_t idle = xQueueCreate(FILE_PIPELINE_READERS, sizeof(file_pipeline_t*));
+  if (idle == NULL)
+    return NULL;
+
+  int started = 0;
+  for (int i = 0; i < FILE_PIPELINE_READERS; i++) {
+    file_pipeline_t* pipe = new file_pipeline_t();
+    pipe->empty = xQueueCreate(2, sizeof(file_pipeline_chunk_t));
+    pipe->full = xQueueCreate(2, sizeof(file_pipeline_chunk_t));
+    pipe->done = xSemaphoreCreateBinary();
+
+    if (pipe->empty == NULL || pipe->full == NULL || pipe->done == NULL ||
+        xTaskCreate(file_pipeline_reader_task, "psychic_file", FILE_PIPELINE_TASK_STACK_SIZE, pipe, FILE_PIPELINE_TASK_PRIORITY, &pipe->task) != pdPASS) {
+      ESP_LOGE(PH_TAG, "Unable to start file pipeline reader");
+      if (pipe->empty)
+        vQueueDelete(pipe->empty);
+      if (pipe->full)
+        vQueueDelete(pipe->full);
+      if (pipe->done)
+        vSemaphoreDelete(pipe->done);
+      delete pipe;
+      break;
+    }
+
+    xQueueSend(idle, &pipe, 0);
+    started++;
+  }
+
+  if (started == 0) {
+    vQueueDelete(idle);
+    return NULL;
+  }
+
+  return idle;
+}
+
+static QueueHandle_t file_pipeline_readers()
+{
+  // started on first use, the same readers serve every server
+  static QueueHandle_t idle = file_pipeline_start();
+  return idle;
+}
 
 PsychicFileResponse::PsychicFileResponse(PsychicResponse* response, FS& fs, const String& path, const String& contentType, bool download) : PsychicResponseDelegate(response)
 {
@@ -135,38 +227,133 @@ esp_err_t PsychicFileResponse::send()
     err = _response->send();
 
     free(buffer);
-  } else {
-    /* Retrieve the pointer to scratch buffer for temporary storage */
-    char* chunk = (char*)malloc(FILE_CHUNK_SIZE);
-    if (chunk == NULL) {
-      ESP_LOGE(PH_TAG, "Unable to allocate %" PRIu32 " bytes to send chunk", FILE_CHUNK_SIZE);
-      httpd_resp_send_err(request(), HTTPD_500_INTERNAL_SERVER_ERROR, "Unable to allocate memory.");
-      return ESP_FAIL;
+  } else if (_pipelined)
+    err = _sendPipelined();
+  else
+    err = _sendChunked();
+
+  return err;
+}
+
+esp_err_t PsychicFileResponse::_sendChunked()
+{
+  esp_err_t err = ESP_OK;
+
+  /* Retrieve the pointer to scratch buffer for temporary storage */
+  char* chunk = (char*)malloc(FILE_CHUNK_SIZE);
+  if (chunk == NULL) {
+    ESP_LOGE(PH_TAG, "Unable to allocate %" PRIu32 " bytes to send chunk", FILE_CHUNK_SIZE);
+    httpd_resp_send_err(request(), HTTPD_500_INTERNAL_SERVER_ERROR, "Unable to allocate memory.");
+    return ESP_FAIL;
+  }
+
+  // now the headers
+  sendHeaders();
+
+  size_t chunksize;
+  do {
+    /* Read file in chunks into the scratch buffer */
+    chunksize = _content.readBytes(chunk, FILE_CHUNK_SIZE);
+    if (chunksize > 0) {
+      err = sendChunk((uint8_t*)chunk, chunksize);
+      if (err != ESP_OK)
+        break;
     }
 
-    // now the headers
-    sendHeaders();
+    /* Keep looping till the whole file is sent */
+  } while (chunksize != 0);
+
+  // keep track of our memory
+  free(chunk);
+
+  if (err == ESP_OK) {
+    ESP_LOGD(PH_TAG, "File sending complete");
+    finishChunking();
+  }
+
+  return err;
+}
+
+size_t PsychicFileResponse::_pipelineChunkSize()
+{
+  // size our chunks to the socket send buffer so each send can go straight out. this is the
+  // buffer's configured size, read once per response, not the live send window.
+  int sndbuf = 0;
+  socklen_t len = sizeof(sndbuf);
+  if (getsockopt(httpd_req_to_sockfd(request()), SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0 || sndbuf <= 0) {
+#ifdef CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+    sndbuf = CONFIG_LWIP_TCP_SND_BUF_DEFAULT;
+#else
+    return FILE_CHUNK_SIZE;
+#endif
+  }
+
+  // never smaller than a full segment, never bigger than our normal chunk
+  return std::min(std::max((size_t)sndbuf, (size_t)1460), (size_t)FILE_CHUNK_SIZE);
+}
+
+esp_err_t PsychicFileResponse::_sendPipelined()
+{
+  esp_err_t err = ESP_OK;
+
+  // every reader is busy with another response, just read inline
+  file_pipeline_t* pipe = NULL;
+  QueueHandle_t readers = file_pipeline_readers();
+  if (readers == NULL || xQueueReceive(readers, &pipe, 0) != pdTRUE)
+    return _sendChunked();
+
+  size_t chunkSize = _pipelineChunkSize();
 
-    size_t chunksize;
-    do {
-      /* Read file in chunks into the scratch buffer */
-      chunksize = _content.readBytes(chunk, FILE_CHUNK_SIZE);
-      if (chunksize > 0) {
-        err = sendChunk((uint8_t*)chunk, chunksize);
-        if (err != ESP_OK)
-          break;
-      }
+  // one allocation for both of our buffers
+  uint8_t* buffer = (uint8_t*)malloc(chunkSize * 2);
+  if (buffer == NULL) {
+    xQueueSend(readers, &pipe, 0);
+    ESP_LOGE(PH_TAG, "Unable to allocate %u bytes to send chunk", (unsigned)(chunkSize * 2));
+    httpd_resp_send_err(request(), HTTPD_500_INTERNAL_SERVER_ERROR, "Unable to allocate memory.");
+    return ESP_FAIL;
+  }
+
+  // now the headers
+  sendHeaders();
 
-      /* Keep looping till the whole file is sent */
-    } while (chunksize != 0);
+  pipe->file = &_content;
+  pipe->chunkSize = chunkSize;
 
-    // keep track of our memory
-    free(chunk);
+  // prime the reader with both buffers
+  file_pipeline_chunk_t chunk = {buffer, 0};
+  xQueueSend(pipe->empty, &chunk, 0);
+  chunk.data = buffer + chunkSize;
+  xQueueSend(pipe->empty, &chunk, 0);
+  xTaskNotifyGive(pipe->task);
 
-    if (err == ESP_OK) {
-      ESP_LOGD(PH_TAG, "File sending complete");
-      finishChunking();
+  // send whatever the reader has filled, then hand the buffer back for the next read
+  while (xQueueReceive(pipe->full, &chunk, portMAX_DELAY) == pdTRUE) {
+    if (chunk.len == 0)
+      break;
+
+    err = sendChunk(chunk.data, chunk.len);
+    if (err != ESP_OK) {
+      // tell the reader to stop
+      chunk.data = NULL;
+      xQueueSend(pipe->empty, &chunk, portMAX_DELAY);
+      break;
     }
+
+    xQueueSend(pipe->empty, &chunk, portMAX_DELAY);
+  }
+
+  // wait for the reader to let go of our buffers, then clear out anything it left behind
+  xSemaphoreTake(pipe->done, portMAX_DELAY);
+  xQueueReset(pipe->empty);
+  xQueueReset(pipe->full);
+  pipe->file = NULL;
+  xQueueSend(readers, &pipe, 0);
+
+  free(buffer);
+
+  if (err == ESP_OK) {
+    ESP_LOGD(PH_TAG, "File sending complete");
+    finishChunking();
   }
 
   return err;
@@ -13,12 +13,22 @@ class PsychicFileResponse : public PsychicResponseDelegate
 
   protected:
     File _content;
+    bool _pipelined = false;
     void _setContentTypeFromPath(const String& path);
+    size_t _pipelineChunkSize();
+    esp_err_t _sendChunked();
+    esp_err_t _sendPipelined();
 
   public:
     PsychicFileResponse(PsychicResponse* response, FS& fs, const String& path, const String& contentType = String(), bool download = false);
     PsychicFileResponse(PsychicResponse* response, File content, const String& path, const String& contentType = String(), bool download = false);
     ~PsychicFileResponse();
+
+    // read the next chunk on a shared reader task while the current one is being sent, falls back
+    // to reading inline when all FILE_PIPELINE_READERS are busy
+    void setPipelined(bool pipelined) { _pipelined = pipelined; }
+    bool isPipelined() const { return _pipelined; }
+
     esp_err_t send();
 };
 
@@ -0,0 +1,176 @@
+#include "PsychicFragmentCache.h"
+
+// collects a fragment's output so it can be kept
+class FragmentPrinter : public Print
+{
+  public:
+    std::vector<uint8_t> data;
+
+    size_t write(uint8_t c) override
+    {
+      data.push_back(c);
+      return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+      data.insert(data.end(), buffer, buffer + size);
+      return size;
+    }
+};
+
+PsychicFragmentCache::Fragment::Fragment(const char* name, PsychicTemplateCallback compute, uint32_t ttl, const char* key) : _name(name),
+                                                                                                                             _key(key),
+                                                                                                                             _ttl(ttl),
+                                                                                                                             _compute(compute),
+                                                                                                                             _handled(false),
+                                                                                                                             _computedAt(0),
+                                                                                                                             _generation(0)
+{
+  _computing = xSemaphoreCreateMutex();
+}
+
+PsychicFragmentCache::Fragment::~Fragment()
+{
+  vSemaphoreDelete(_computing);
+}
+
+PsychicFragmentCache::PsychicFragmentCache() : _hits(0),
+                                               _misses(0)
+{
+  _lock = xSemaphoreCreateMutex();
+}
+
+PsychicFragmentCache::~PsychicFragmentCache()
+{
+  for (auto& fragment : _fragments)
+    delete fragment.second;
+  _fragments.clear();
+
+  vSemaphoreDelete(_lock);
+}
+
+PsychicFragmentCache::Fragment* PsychicFragmentCache::add(const char* name, PsychicTemplateCallback compute, uint32_t ttl, const char* key)
+{
+  Fragment* fragment = find(name);
+  if (fragment != NULL) {
+    ESP_LOGE(PH_TAG, "Fragment %s already exists", name);
+    return fragment;
+  }
+
+  fragment = new Fragment(name, compute, ttl, key);
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _fragments[name] = fragment;
+  xSemaphoreGive(_lock);
+
+  return fragment;
+}
+
+PsychicFragmentCache::Fragment* PsychicFragmentCache::find(const char* name)
+{
+  Fragment* fragment = NULL;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  auto it = _fragments.find(name);
+  if (it != _fragments.end())
+    fragment = it->second;
+  xSemaphoreGive(_lock);
+
+  return fragment;
+}
+
+// call with _lock held
+bool PsychicFragmentCache::_fresh(Fragment* fragment)
+{
+  if (!fragment->_data)
+    return false;
+  return !fragment->_ttl || millis() - fragment->_computedAt < fragment->_ttl;
+}
+
+bool PsychicFragmentCache::render(Fragment* fragment, Print& output)
+{
+  std::shared_ptr<const std::vector<uint8_t>> data;
+  bool handled;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  bool fresh = _fresh(fragment);
+  if (fresh) {
+    data = fragment->_data;
+    handled = fragment->_handled;
+    _hits++;
+  }
+  xSemaphoreGive(_lock);
+
+  if (!fresh) {
+    // one task computes, anyone else who got here in the meantime finds it fresh afterwards
+    xSemaphoreTake(fragment->_computing, portMAX_DELAY);
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    fresh = _fresh(fragment);
+    if (fresh) {
+      data = fragment->_data;
+      handled = fragment->_handled;
+      _hits++;
+    }
+    uint32_t generation = fragment->_generation;
+    xSemaphoreGive(_lock);
+
+    if (!fresh) {
+      FragmentPrinter printer;
+      handled = fragment->_compute(printer);
+      printer.data.shrink_to_fit();
+      data = std::make_shared<const std::vector<uint8_t>>(std::move(printer.data));
+
+      // invalidated while we were computing: this render still uses it, but it isn't kept
+      xSemaphoreTake(_lock, portMAX_DELAY);
+      if (fragment->_generation == generation) {
+        fragment->_data = data;
+        fragment->_handled = handled;
+        fragment->_computedAt = millis();
+      }
+      _misses++;
+      xSemaphoreGive(_lock);
+    }
+
+    xSemaphoreGive(fragment->_computing);
+  }
+
+  if (handled && !data->empty())
+    output.write(data->data(), data->size());
+  return handled;
+}
+
+// call with _lock held
+void PsychicFragmentCache::_invalidate(Fragment* fragment)
+{
+  fragment->_data.reset();
+  fragment->_generation++;
+}
+
+void PsychicFragmentCache::invalidate(const char* name)
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  auto it = _fragments.find(name);
+  if (it != _fragments.end())
+    _invalidate(it->second);
+  xSemaphoreGive(_lock);
+}
+
+void PsychicFragmentCache::invalidateKey(const char* key)
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (auto& fragment : _fragments) {
+    if (fragment.second->_key.equals(key))
+      _invalidate(fragment.second);
+  }
+  xSemaphoreGive(_lock);
+}
+
+void PsychicFragmentCache::invalidateAll()
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (auto& fragment : _fragments)
+    _invalidate(fragment.second);
+  xSemaphoreGive(_lock);
+}
@@ -0,0 +1,75 @@
+#ifndef PsychicFragmentCache_h
+#define PsychicFragmentCache_h
+
+#include "PsychicCore.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <memory>
+#include <vector>
+
+typedef std::function<bool(Print& output)> PsychicTemplateCallback;
+
+/*
+ * PsychicFragmentCache :: keeps the rendered output of slow or rarely changing template placeholders
+ *
+ * Each fragment is recomputed when its ttl runs out (0 = never) or when it, or the key it was added
+ * with, is invalidated. If several renders find a fragment stale at the same time, one computes it
+ * and the others wait and reuse the result. Attach it to a PsychicTemplate with setFragmentCache().
+ */
+
+class PsychicFragmentCache
+{
+  public:
+    class Fragment
+    {
+        friend class PsychicFragmentCache;
+
+      protected:
+        String _name;
+        String _key;
+        uint32_t _ttl;
+        PsychicTemplateCallback _compute;
+
+        // only swapped while holding the cache lock, writers keep their own reference
+        std::shared_ptr<const std::vector<uint8_t>> _data;
+        bool _handled;
+        unsigned long _computedAt;
+        uint32_t _generation; // bumped by every invalidate, a compute that started before it isn't kept
+        SemaphoreHandle_t _computing;
+
+        Fragment(const char* name, PsychicTemplateCallback compute, uint32_t ttl, const char* key);
+        ~Fragment();
+
+      public:
+        const String& name() { return _name; }
+    };
+
+  protected:
+    std::map<String, Fragment*> _fragments;
+    SemaphoreHandle_t _lock;
+    uint32_t _hits;
+    uint32_t _misses;
+
+    bool _fresh(Fragment* fragment);
+    void _invalidate(Fragment* fragment);
+
+  public:
+    PsychicFragmentCache();
+    ~PsychicFragmentCache();
+
+    // add before the templates using it are first rendered
+    Fragment* add(const char* name, PsychicTemplateCallback compute, uint32_t ttl = 0, const char* key = "");
+    Fragment* find(const char* name);
+
+    // same contract as a template callback: false means the placeholder is printed as is
+    bool render(Fragment* fragment, Print& output);
+
+    void invalidate(const char* name);
+    void invalidateKey(const char* key);
+    void invalidateAll();
+
+    uint32_t hits() { return _hits; }
+    uint32_t misses() { return _misses; }
+};
+
+#endif // PsychicFragmentCache_h
@@ -7,9 +7,9 @@ PsychicHandler::PsychicHandler()
 PsychicHandler::~PsychicHandler()
 {
   delete _chain;
-  // actual PsychicClient deletion handled by PsychicServer
-  // for (PsychicClient *client : _clients)
-  //   delete(client);
+  // actual PsychicClient deletion handled by PsychicServer, just make sure they forget about us
+  for (PsychicClient* client : _clients)
+    client->_unsubscribe(this);
   _clients.clear();
 }
 
@@ -63,12 +63,14 @@ void PsychicHandler::checkForClosedClient(PsychicClient* client)
 
 void PsychicHandler::addClient(PsychicClient* client)
 {
-  _clients.push_back(client);
+  if (_clients.add(client))
+    client->_subscribe(this);
 }
 
 void PsychicHandler::removeClient(PsychicClient* client)
 {
-  _clients.remove(client);
+  if (_clients.remove(client))
+    client->_unsubscribe(this);
 }
 
 PsychicClient* PsychicHandler::getClient(int socket)
@@ -78,12 +80,7 @@ PsychicClient* PsychicHandler::getClient(int socket)
     return NULL;
 
   // what about us?
-  for (PsychicClient* client : _clients)
-    if (client->socket() == socket)
-      return client;
-
-  // nothing found.
-  return NULL;
+  return _clients.get(socket);
 }
 
 PsychicClient* PsychicHandler::getClient(PsychicClient* client)
@@ -98,7 +95,7 @@ bool PsychicHandler::hasClient(PsychicClient* socket)
 
 const std::list<PsychicClient*>& PsychicHandler::getClientList()
 {
-  return _clients;
+  return _clients.list();
 }
 
 PsychicHandler* PsychicHandler::addMiddleware(PsychicMiddleware* middleware)
@@ -1,6 +1,7 @@
 #ifndef PsychicHandler_h
 #define PsychicHandler_h
 
+#include "PsychicClientTable.h"
 #include "PsychicCore.h"
 #include "PsychicRequest.h"
 
@@ -8,6 +9,7 @@ class PsychicEndpoint;
 class PsychicHttpServer;
 class PsychicMiddleware;
 class PsychicMiddlewareChain;
+class PsychicRouteGroup;
 
 /*
  * HANDLER :: Can be attached to any endpoint or as a generic request handler.
@@ -16,6 +18,7 @@ class PsychicMiddlewareChain;
 class PsychicHandler
 {
     friend PsychicEndpoint;
+    friend PsychicRouteGroup;
 
   protected:
     PsychicHttpServer* _server = nullptr;
@@ -24,7 +27,7 @@ class PsychicHandler
 
     String _subprotocol;
 
-    std::list<PsychicClient*> _clients;
+    PsychicClientTable _clients;
 
   public:
     PsychicHandler();
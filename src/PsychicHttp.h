@@ -3,19 +3,30 @@
 
 // #define ENABLE_ASYNC // This is something added in ESP-IDF 5.1.x where each request can be handled in its own thread
 
+#include "PsychicCoroutine.h"
+#include "PsychicDeferredRequest.h"
 #include "PsychicEndpoint.h"
 #include "PsychicEventSource.h"
 #include "PsychicFileResponse.h"
+#include "PsychicFragmentCache.h"
 #include "PsychicHandler.h"
 #include "PsychicHttpServer.h"
 #include "PsychicJson.h"
+#include "PsychicJsonBinding.h"
+#include "PsychicJsonPool.h"
 #include "PsychicMiddleware.h"
 #include "PsychicMiddlewareChain.h"
 #include "PsychicMiddlewares.h"
+#include "PsychicPipeResponse.h"
+#include "PsychicRateLimiter.h"
 #include "PsychicRequest.h"
+#include "PsychicRequestStream.h"
 #include "PsychicResponse.h"
+#include "PsychicResponseCache.h"
+#include "PsychicRouteGroup.h"
 #include "PsychicStaticFileHandler.h"
 #include "PsychicStreamResponse.h"
+#include "PsychicTemplate.h"
 #include "PsychicUploadHandler.h"
 #include "PsychicVersion.h"
 #include "PsychicWebSocket.h"
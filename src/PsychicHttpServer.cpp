@@ -1,7 +1,9 @@
 #include "PsychicHttpServer.h"
+#include "PsychicCoroutine.h"
 #include "PsychicEndpoint.h"
 #include "PsychicHandler.h"
 #include "PsychicJson.h"
+#include "PsychicJsonPool.h"
 #include "PsychicStaticFileHandler.h"
 #include "PsychicWebHandler.h"
 #include "PsychicWebSocket.h"
@@ -15,6 +17,11 @@ PsychicHttpServer::PsychicHttpServer(uint16_t port)
   maxRequestBodySize = MAX_REQUEST_BODY_SIZE;
   maxUploadSize = MAX_UPLOAD_SIZE;
 
+  _jsonPool = new PsychicJsonPool();
+#ifdef ENABLE_COROUTINES
+  _coroutines = new PsychicCoroutineScheduler();
+#endif
+
   defaultEndpoint = new PsychicEndpoint(this, HTTP_GET, "");
   onNotFound(PsychicHttpServer::defaultNotFoundHandler);
 
@@ -47,9 +54,7 @@ PsychicHttpServer::~PsychicHttpServer()
 {
   _esp_idf_endpoints.clear();
 
-  for (auto* client : _clients)
-    delete (client);
-  _clients.clear();
+  _dropClients();
 
   for (auto* endpoint : _endpoints)
     delete (endpoint);
@@ -63,8 +68,16 @@ PsychicHttpServer::~PsychicHttpServer()
     delete (rewrite);
   _rewrites.clear();
 
+  for (auto* group : _groups)
+    delete (group);
+  _groups.clear();
+
   delete defaultEndpoint;
   delete _chain;
+  delete _jsonPool;
+#ifdef ENABLE_COROUTINES
+  delete _coroutines;
+#endif
 }
 
 void PsychicHttpServer::destroy(void* ctx)
@@ -111,10 +124,32 @@ esp_err_t PsychicHttpServer::start()
   esp_err_t ret;
 
 #ifdef ENABLE_ASYNC
+  // leave at least one socket for quick synchronous requests, see the constructor
+  if (config.max_open_sockets <= _workers.workers()) {
+    ESP_LOGW(PH_TAG, "max_open_sockets raised from %d to %d, one more than the async workers", (int)config.max_open_sockets, (int)_workers.workers() + 1);
+    config.max_open_sockets = _workers.workers() + 1;
+  }
+
   // start workers
-  start_async_req_workers();
+  ret = _workers.begin();
+  if (ret != ESP_OK) {
+    ESP_LOGE(PH_TAG, "Async workers failed to start (%s)", esp_err_to_name(ret));
+    return ret;
+  }
+#endif
+
+#ifdef ENABLE_COROUTINES
+  ret = _coroutines->begin();
+  if (ret != ESP_OK) {
+    ESP_LOGE(PH_TAG, "Coroutine scheduler failed to start (%s)", esp_err_to_name(ret));
+    return ret;
+  }
 #endif
 
+  // one slot per socket httpd may have open, plus the listening and control sockets.
+  // sized up front so the table never moves while other tasks look clients up
+  _clients.reserve(std::max<size_t>(config.max_open_sockets + 3, CLIENT_TABLE_SIZE));
+
   // one URI handler for each http_method
   config.max_uri_handlers = supported_methods.size() + _esp_idf_endpoints.size();
 
@@ -173,6 +208,15 @@ esp_err_t PsychicHttpServer::stop()
   if (!_running)
     return ESP_OK;
 
+#ifdef ENABLE_ASYNC
+  // let the workers finish up while their sockets are still open
+  _workers.end();
+#endif
+
+#ifdef ENABLE_COROUTINES
+  _coroutines->end();
+#endif
+
   // some handlers (aka websockets) need actual endpoints in esp-idf http_server
   for (auto& endpoint : _esp_idf_endpoints) {
     ESP_LOGD(PH_TAG, "Removing endpoint %s | %s", endpoint.uri, http_method_str((http_method)endpoint.method));
@@ -209,14 +253,26 @@ esp_err_t PsychicHttpServer::_stopServer()
   return httpd_stop(this->server);
 }
 
+void PsychicHttpServer::_dropClients()
+{
+  for (auto* client : _clients) {
+    // handlers let go of it first, so nothing is left pointing at a deleted client
+    std::vector<PsychicHandler*> handlers;
+    client->takeHandlers(handlers);
+    for (PsychicHandler* handler : handlers)
+      handler->removeClient(client);
+
+    delete (client);
+  }
+  _clients.clear();
+}
+
 void PsychicHttpServer::reset()
 {
   if (_running)
     stop();
 
-  for (auto* client : _clients)
-    delete (client);
-  _clients.clear();
+  _dropClients();
 
   for (auto* endpoint : _endpoints)
     delete (endpoint);
@@ -230,6 +286,10 @@ void PsychicHttpServer::reset()
     delete (rewrite);
   _rewrites.clear();
 
+  for (auto* group : _groups)
+    delete (group);
+  _groups.clear();
+
   _esp_idf_endpoints.clear();
 
   onNotFound(PsychicHttpServer::defaultNotFoundHandler);
@@ -303,7 +363,7 @@ PsychicEndpoint* PsychicHttpServer::on(const char* uri, int method, PsychicHandl
   if (handler->isWebSocket()) {
     // URI handler structure
     httpd_uri_t my_uri;
-    my_uri.uri = uri;
+    my_uri.uri = endpoint->_uri.c_str(); // uri may be a temporary, eg. from a route group
     my_uri.method = HTTP_GET;
     my_uri.handler = PsychicEndpoint::requestCallback;
     my_uri.user_ctx = endpoint;
@@ -356,6 +416,26 @@ PsychicEndpoint* PsychicHttpServer::on(const char* uri, int method, PsychicJsonR
   return on(uri, method, handler);
 }
 
+#ifdef ENABLE_COROUTINES
+PsychicEndpoint* PsychicHttpServer::on(const char* uri, PsychicCoroutineCallback fn)
+{
+  return on(uri, HTTP_GET, fn);
+}
+
+PsychicEndpoint* PsychicHttpServer::on(const char* uri, int method, PsychicCoroutineCallback fn)
+{
+  PsychicCoroutineHandler* handler = new PsychicCoroutineHandler(fn);
+  return on(uri, method, handler);
+}
+#endif
+
+PsychicRouteGroup* PsychicHttpServer::group(const char* prefix)
+{
+  PsychicRouteGroup* group = new PsychicRouteGroup(this, NULL, prefix);
+  _groups.push_back(group);
+  return group;
+}
+
 bool PsychicHttpServer::removeEndpoint(const char* uri, int method)
 {
   // some handlers (aka websockets) need actual endpoints in esp-idf http_server
@@ -429,6 +509,13 @@ void PsychicHttpServer::removeMiddleware(PsychicMiddleware* middleware)
   }
 }
 
+void PsychicHttpServer::setJsonPool(PsychicJsonPool* pool)
+{
+  delete _jsonPool;
+  // an empty pool just builds and frees documents on demand
+  _jsonPool = pool ? pool : new PsychicJsonPool(0);
+}
+
 void PsychicHttpServer::onNotFound(PsychicHttpRequestCallback fn)
 {
   PsychicWebHandler* handler = new PsychicWebHandler();
@@ -457,21 +544,37 @@ esp_err_t PsychicHttpServer::requestHandler(httpd_req_t* req)
   // process any URL rewrites
   server->_rewriteRequest(&request);
 
+  // offloaded requests passed the global filters before they were handed over
+  bool offloaded = false;
+#ifdef ENABLE_ASYNC
+  offloaded = server->_workers.isWorkerThread();
+#endif
+
   // run it through our global server filter list
-  if (!server->_filter(&request)) {
+  if (!offloaded && !server->_filter(&request)) {
     ESP_LOGD(PH_TAG, "Request %s refused by global filter", request.uri().c_str());
     return request.response()->send(400);
   }
 
-  // then runs the request through the filter chain
-  esp_err_t ret;
-  if (server->_chain) {
-    ret = server->_chain->runChain(&request, [server, &request]() {
-      return server->_process(&request);
+  PsychicEndpoint* endpoint = server->_findEndpoint(&request);
+
+#ifdef ENABLE_ASYNC
+  // hand slow endpoints to the workers, they come back through here and run inline
+  if (!offloaded && endpoint != NULL && endpoint->offload()) {
+    if (endpoint->submitRequest(req, PsychicHttpServer::requestHandler))
+      return ESP_OK;
+
+    // turned away, the 503 still goes through the global middleware so auth and CORS get their say
+    return server->_runChain(&request, [server, &request]() {
+      return server->_workers.sendBusy(request.response());
     });
-  } else {
-    ret = server->_process(&request);
   }
+#endif
+
+  // then runs the request through the filter chain
+  esp_err_t ret = server->_runChain(&request, [server, &request, endpoint]() {
+    return server->_process(&request, endpoint);
+  });
   ESP_LOGD(PH_TAG, "Request %s processed by global middleware: %s", request.uri().c_str(), esp_err_to_name(ret));
 
   if (ret == HTTPD_404_NOT_FOUND) {
@@ -481,17 +584,29 @@ esp_err_t PsychicHttpServer::requestHandler(httpd_req_t* req)
   return ret;
 }
 
-esp_err_t PsychicHttpServer::_process(PsychicRequest* request)
+esp_err_t PsychicHttpServer::_runChain(PsychicRequest* request, PsychicMiddlewareNext::Finalizer finalizer, void* ctx)
+{
+  return _chain ? _chain->runChain(request, finalizer, ctx) : finalizer(ctx);
+}
+
+PsychicEndpoint* PsychicHttpServer::_findEndpoint(PsychicRequest* request)
 {
-  // loop through our endpoints and see if anyone wants it.
   for (auto* endpoint : _endpoints) {
     if (endpoint->matches(request->uri().c_str())) {
-      if (endpoint->_method == request->method() || endpoint->_method == HTTP_ANY) {
-        request->setEndpoint(endpoint);
-        return endpoint->process(request);
-      }
+      if (endpoint->_method == request->method() || endpoint->_method == HTTP_ANY)
+        return endpoint;
     }
   }
+  return NULL;
+}
+
+esp_err_t PsychicHttpServer::_process(PsychicRequest* request, PsychicEndpoint* endpoint)
+{
+  // the endpoint requestHandler() found for it, if any
+  if (endpoint != NULL) {
+    request->setEndpoint(endpoint);
+    return endpoint->process(request);
+  }
 
   // loop through our global handlers and see if anyone wants it
   for (auto* handler : _handlers) {
@@ -542,6 +657,7 @@ esp_err_t PsychicHttpServer::openCallback(httpd_handle_t hd, int sockfd)
   PsychicClient* client = server->getClient(sockfd);
   if (client == NULL) {
     client = new PsychicClient(hd, sockfd);
+    client->capture();
     server->addClient(client);
   }
 
@@ -566,11 +682,11 @@ void PsychicHttpServer::closeCallback(httpd_handle_t hd, int sockfd)
   // lookup our client
   PsychicClient* client = server->getClient(sockfd);
   if (client != NULL) {
-    // give our handlers a chance to handle a disconnect first
-    for (PsychicEndpoint* endpoint : server->_endpoints) {
-      PsychicHandler* handler = endpoint->handler();
+    // give the handlers tracking this client a chance to handle a disconnect first
+    std::vector<PsychicHandler*> handlers;
+    client->takeHandlers(handlers);
+    for (PsychicHandler* handler : handlers)
       handler->checkForClosedClient(client);
-    }
 
     // do we have a callback attached?
     if (server->_onClose != NULL)
@@ -595,7 +711,7 @@ PsychicStaticFileHandler* PsychicHttpServer::serveStatic(const char* uri, fs::FS
 
 void PsychicHttpServer::addClient(PsychicClient* client)
 {
-  _clients.push_back(client);
+  _clients.add(client);
 }
 
 void PsychicHttpServer::removeClient(PsychicClient* client)
@@ -606,11 +722,7 @@ void PsychicHttpServer::removeClient(PsychicClient* client)
 
 PsychicClient* PsychicHttpServer::getClient(int socket)
 {
-  for (PsychicClient* client : _clients)
-    if (client->socket() == socket)
-      return client;
-
-  return NULL;
+  return _clients.get(socket);
 }
 
 PsychicClient* PsychicHttpServer::getClient(httpd_req_t* req)
@@ -625,17 +737,17 @@ bool PsychicHttpServer::hasClient(int socket)
 
 const std::list<PsychicClient*>& PsychicHttpServer::getClientList()
 {
-  return _clients;
+  return _clients.list();
 }
 
 bool ON_STA_FILTER(PsychicRequest* request)
 {
-  return WiFi.localIP() == request->client()->localIP();
+  return request->client()->interface() == INTERFACE_STA;
 }
 
 bool ON_AP_FILTER(PsychicRequest* request)
 {
-  return WiFi.softAPIP() == request->client()->localIP();
+  return request->client()->interface() == INTERFACE_AP;
 }
 
 String urlDecode(const char* encoded)
@@ -2,11 +2,14 @@
 #define PsychicHttpServer_h
 
 #include "PsychicClient.h"
+#include "PsychicClientTable.h"
 #include "PsychicCore.h"
 #include "PsychicHandler.h"
 #include "PsychicMiddleware.h"
 #include "PsychicMiddlewareChain.h"
 #include "PsychicRewrite.h"
+#include "PsychicRouteGroup.h"
+#include "PsychicWorkerPool.h"
 
 #ifdef PSY_ENABLE_REGEX
   #include <regex>
@@ -18,6 +21,8 @@
 
 class PsychicEndpoint;
 class PsychicHandler;
+class PsychicJsonPool;
+class PsychicCoroutineScheduler;
 class PsychicStaticFileHandler;
 
 class PsychicHttpServer
@@ -26,13 +31,19 @@ class PsychicHttpServer
     std::list<httpd_uri_t> _esp_idf_endpoints;
     std::list<PsychicEndpoint*> _endpoints;
     std::list<PsychicHandler*> _handlers;
-    std::list<PsychicClient*> _clients;
+    PsychicClientTable _clients;
     std::list<PsychicRewrite*> _rewrites;
     std::list<PsychicRequestFilterFunction> _filters;
+    std::list<PsychicRouteGroup*> _groups;
 
     PsychicClientCallback _onOpen = nullptr;
     PsychicClientCallback _onClose = nullptr;
     PsychicMiddlewareChain* _chain = nullptr;
+    PsychicJsonPool* _jsonPool = nullptr;
+    PsychicWorkerPool _workers;
+#ifdef ENABLE_COROUTINES
+    PsychicCoroutineScheduler* _coroutines = nullptr;
+#endif
 
     esp_err_t _start();
     virtual esp_err_t _startServer();
@@ -41,8 +52,25 @@ class PsychicHttpServer
     httpd_uri_match_func_t _uri_match_fn = nullptr;
 
     bool _rewriteRequest(PsychicRequest* request);
-    esp_err_t _process(PsychicRequest* request);
+    esp_err_t _process(PsychicRequest* request, PsychicEndpoint* endpoint);
+    PsychicEndpoint* _findEndpoint(PsychicRequest* request);
     bool _filter(PsychicRequest* request);
+    void _dropClients();
+
+    // through the global middleware, if there is any. the chain is only complete in the .cpp
+    esp_err_t _runChain(PsychicRequest* request, PsychicMiddlewareNext::Finalizer finalizer, void* ctx);
+
+    template <typename F>
+    esp_err_t _runChain(PsychicRequest* request, F&& finalizer)
+    {
+      return _runChain(request, &_finalize<typename std::remove_reference<F>::type>, &finalizer);
+    }
+
+    template <typename F>
+    static esp_err_t _finalize(void* ctx)
+    {
+      return (*(F*)ctx)();
+    }
 
   public:
     PsychicHttpServer(uint16_t port = 80);
@@ -67,6 +95,18 @@ class PsychicHttpServer
 
     PsychicEndpoint* defaultEndpoint;
 
+    // reusable documents for the JSON handlers and responses, set before begin() to resize it
+    PsychicJsonPool* getJsonPool() { return _jsonPool; }
+    void setJsonPool(PsychicJsonPool* pool);
+
+    // async request workers (ENABLE_ASYNC), configure them before begin()
+    PsychicWorkerPool* workers() { return &_workers; }
+
+#ifdef ENABLE_COROUTINES
+    // tasks that resume coroutine handlers (ENABLE_COROUTINES), configure them before begin()
+    PsychicCoroutineScheduler* coroutines() { return _coroutines; }
+#endif
+
     static void destroy(void* ctx);
 
     virtual void setPort(uint16_t port);
@@ -111,6 +151,17 @@ class PsychicHttpServer
     PsychicEndpoint* on(const char* uri, int method, PsychicHttpRequestCallback onRequest);
     PsychicEndpoint* on(const char* uri, PsychicJsonRequestCallback onRequest);
     PsychicEndpoint* on(const char* uri, int method, PsychicJsonRequestCallback onRequest);
+    // typed json endpoint, eg. server.on<Setpoint>("/setpoint", HTTP_POST, callback). see PsychicJsonBinding.h
+    template <typename T>
+    PsychicEndpoint* on(const char* uri, int method, PsychicJsonBindingCallback<T> onRequest);
+#ifdef ENABLE_COROUTINES
+    // coroutine endpoint, the callback returns a PsychicTask. see PsychicCoroutine.h
+    PsychicEndpoint* on(const char* uri, PsychicCoroutineCallback onRequest);
+    PsychicEndpoint* on(const char* uri, int method, PsychicCoroutineCallback onRequest);
+#endif
+
+    // endpoints under prefix with their own middleware and filters, see PsychicRouteGroup.h
+    PsychicRouteGroup* group(const char* prefix);
 
     bool removeEndpoint(const char* uri, int method);
     bool removeEndpoint(PsychicEndpoint* endpoint);
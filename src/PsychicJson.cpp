@@ -1,26 +1,117 @@
 #include "PsychicJson.h"
+#include "PsychicHttpServer.h"
+
+// the media type without its parameters, lowercased
+static String mediaType(const String& value, int start, int end)
+{
+  int semi = value.indexOf(';', start);
+  String type = value.substring(start, semi >= 0 && semi < end ? semi : end);
+  type.trim();
+  type.toLowerCase();
+  return type;
+}
+
+static bool isMsgPackMediaType(const String& type)
+{
+  return type.equals("application/msgpack") || type.equals("application/x-msgpack") || type.equals("application/vnd.msgpack");
+}
+
+// Content-Type: application/msgpack, application/x-msgpack
+static bool isMsgPackType(const String& contentType)
+{
+  return isMsgPackMediaType(mediaType(contentType, 0, contentType.length()));
+}
+
+// true if the Accept header ranks MessagePack above JSON, JSON wins ties unless it only matched a wildcard
+static bool prefersMsgPack(const String& accept)
+{
+  float msgPackQ = 0;
+  float jsonQ = 0;
+  bool jsonListed = false;
+  float wildcardQ = 0;
+
+  int start = 0;
+  while (start < (int)accept.length()) {
+    int end = accept.indexOf(',', start);
+    if (end < 0)
+      end = accept.length();
+
+    String type = mediaType(accept, start, end);
+
+    float q = 1;
+    int param = accept.indexOf(';', start);
+    while (param >= 0 && param < end) {
+      int next = accept.indexOf(';', param + 1);
+      if (next < 0 || next > end)
+        next = end;
+      String name = accept.substring(param + 1, next);
+      name.trim();
+      if (name.startsWith("q=") || name.startsWith("Q="))
+        q = name.substring(2).toFloat();
+      param = next < end ? next : -1;
+    }
+
+    if (isMsgPackMediaType(type))
+      msgPackQ = std::max(msgPackQ, q);
+    else if (type.equals("application/json")) {
+      jsonQ = jsonListed ? std::max(jsonQ, q) : q;
+      jsonListed = true;
+    } else if (type.equals("application/*") || type.equals("*/*"))
+      wildcardQ = std::max(wildcardQ, q);
+
+    start = end + 1;
+  }
+
+  if (msgPackQ <= 0)
+    return false;
+  if (jsonListed)
+    return msgPackQ > jsonQ;
+  return msgPackQ >= wildcardQ;
+}
+
+// parse the input as JSON or MessagePack, through the filter if there is one
+template <typename TInput>
+static DeserializationError deserializeBody(PsychicJsonDocument& doc, TInput& input, bool msgPack, JsonVariantConst filter)
+{
+  if (filter.isNull())
+    return msgPack ? deserializeMsgPack(doc, input) : deserializeJson(doc, input);
+  else
+    return msgPack ? deserializeMsgPack(doc, input, DeserializationOption::Filter(filter)) : deserializeJson(doc, input, DeserializationOption::Filter(filter));
+}
 
 #ifdef ARDUINOJSON_6_COMPATIBILITY
-PsychicJsonResponse::PsychicJsonResponse(PsychicResponse* response, bool isArray, size_t maxJsonBufferSize) : __response(response),
-                                                                                                              _jsonBuffer(maxJsonBufferSize)
+PsychicJsonResponse::PsychicJsonResponse(PsychicResponse* response, bool isArray, size_t maxJsonBufferSize) : PsychicResponseDelegate(response)
 {
-  response->setContentType(JSON_MIMETYPE);
+  _pool = response->getRequest()->server()->getJsonPool();
+  _jsonBuffer = _pool->borrow(maxJsonBufferSize);
+  _msgPack = prefersMsgPack(response->getRequest()->header("Accept"));
+
+  setContentType(JSON_MIMETYPE);
   if (isArray)
-    _root = _jsonBuffer.createNestedArray();
+    _root = _jsonBuffer->createNestedArray();
   else
-    _root = _jsonBuffer.createNestedObject();
+    _root = _jsonBuffer->createNestedObject();
 }
 #else
 PsychicJsonResponse::PsychicJsonResponse(PsychicResponse* response, bool isArray) : PsychicResponseDelegate(response)
 {
+  _pool = response->getRequest()->server()->getJsonPool();
+  _jsonBuffer = _pool->borrow();
+  _msgPack = prefersMsgPack(response->getRequest()->header("Accept"));
+
   setContentType(JSON_MIMETYPE);
   if (isArray)
-    _root = _jsonBuffer.add<JsonArray>();
+    _root = _jsonBuffer->add<JsonArray>();
   else
-    _root = _jsonBuffer.add<JsonObject>();
+    _root = _jsonBuffer->add<JsonObject>();
 }
 #endif
 
+PsychicJsonResponse::~PsychicJsonResponse()
+{
+  _pool->release(_jsonBuffer);
+}
+
 JsonVariant& PsychicJsonResponse::getRoot()
 {
   return _root;
@@ -28,52 +119,80 @@ JsonVariant& PsychicJsonResponse::getRoot()
 
 size_t PsychicJsonResponse::getLength()
 {
+  if (_msgPack)
+    return measureMsgPack(_root);
   return measureJson(_root);
 }
 
 esp_err_t PsychicJsonResponse::send()
 {
-  esp_err_t err = ESP_OK;
-  size_t length = getLength();
-  size_t buffer_size;
-  char* buffer;
+  uint8_t* buffer = (uint8_t*)malloc(JSON_BUFFER_SIZE);
+  if (buffer == NULL) {
+    return error(HTTPD_500_INTERNAL_SERVER_ERROR, "Unable to allocate memory.");
+  }
 
-  // how big of a buffer do we want?
-  if (length < JSON_BUFFER_SIZE)
-    buffer_size = length + 1;
+  // keep our headers
+  setContentType(_msgPack ? MSGPACK_MIMETYPE : JSON_MIMETYPE);
+  addHeader("Vary", "Accept");
+  sendHeaders();
+
+  // serialize in a single pass, it only goes chunked if it doesn't fit in the first buffer
+  ChunkPrinter dest(_response, buffer, JSON_BUFFER_SIZE);
+  if (_msgPack)
+    serializeMsgPack(_root, dest);
   else
-    buffer_size = JSON_BUFFER_SIZE;
+    serializeJson(_root, dest);
+  esp_err_t err = dest.finish();
 
-  buffer = (char*)malloc(buffer_size);
+  // let the buffer go
+  free(buffer);
+
+  return err;
+}
+
+PsychicJsonStreamResponse::PsychicJsonStreamResponse(PsychicResponse* response, PsychicJsonGenerator generator, PsychicJsonStreamFormat format) : PsychicResponseDelegate(response),
+                                                                                                                                     _generator(generator),
+                                                                                                                                     _format(format)
+{
+}
+
+esp_err_t PsychicJsonStreamResponse::send()
+{
+  uint8_t* buffer = (uint8_t*)malloc(JSON_BUFFER_SIZE);
   if (buffer == NULL) {
     return error(HTTPD_500_INTERNAL_SERVER_ERROR, "Unable to allocate memory.");
   }
 
-  // send it in one shot or no?
-  if (length < JSON_BUFFER_SIZE) {
-    serializeJson(_root, buffer, buffer_size);
+  setContentType(_format == JSON_STREAM_NDJSON ? NDJSON_MIMETYPE : JSON_MIMETYPE);
+  sendHeaders();
 
-    setContent((uint8_t*)buffer, length);
-    setContentType(JSON_MIMETYPE);
+  // only ever one element in memory, the document is reused for each of them
+  PsychicJsonPool* pool = _response->getRequest()->server()->getJsonPool();
+  PsychicJsonDocument* doc = pool->borrow();
 
-    err = send();
-  } else {
-    // helper class that acts as a stream to print chunked responses
-    ChunkPrinter dest(_response, (uint8_t*)buffer, buffer_size);
+  ChunkPrinter dest(_response, buffer, JSON_BUFFER_SIZE);
+  if (_format == JSON_STREAM_ARRAY)
+    dest.write('[');
 
-    // keep our headers
-    sendHeaders();
+  // stop early if the client went away
+  for (size_t index = 0; !dest.getWriteError(); index++) {
+    doc->clear();
+    if (!_generator(index, *doc))
+      break;
 
-    serializeJson(_root, dest);
+    if (_format == JSON_STREAM_ARRAY && index > 0)
+      dest.write(',');
+    serializeJson(*doc, dest);
+    if (_format == JSON_STREAM_NDJSON)
+      dest.write('\n');
+  }
 
-    // send the last bits
-    dest.flush();
+  if (_format == JSON_STREAM_ARRAY)
+    dest.write(']');
 
-    // done with our chunked response too
-    err = finishChunking();
-  }
+  pool->release(doc);
 
-  // let the buffer go
+  esp_err_t err = dest.getWriteError() ? ESP_FAIL : dest.finish();
   free(buffer);
 
   return err;
@@ -100,29 +219,79 @@ void PsychicJsonHandler::onRequest(PsychicJsonRequestCallback fn)
   _onRequest = fn;
 }
 
+PsychicJsonHandler* PsychicJsonHandler::setStreamBody(bool stream)
+{
+  _streamBody = stream;
+  return this;
+}
+
+PsychicJsonHandler* PsychicJsonHandler::setMaxStreamBodySize(size_t size)
+{
+  _maxStreamBodySize = size;
+  return this;
+}
+
+#ifndef ARDUINOJSON_6_COMPATIBILITY
+PsychicJsonHandler* PsychicJsonHandler::setJsonFilter(JsonVariantConst filter)
+{
+  _jsonFilter.set(filter);
+  return this;
+}
+#endif
+
 esp_err_t PsychicJsonHandler::handleRequest(PsychicRequest* request, PsychicResponse* response)
 {
   // process basic stuff
-  PsychicWebHandler::handleRequest(request, response);
+  PsychicClient* client = checkForNewClient(request->client());
+  if (client->isNew)
+    openCallback(client);
+
+  // too big is a 413 either way, the streamed body just gets its own limit
+  size_t limit = _streamBody && _maxStreamBodySize ? _maxStreamBodySize : request->server()->maxRequestBodySize;
+  if (request->contentLength() > limit) {
+    ESP_LOGE(PH_TAG, "Request body too large : %d bytes", request->contentLength());
+
+    char error[60];
+    snprintf(error, sizeof(error), "Request body must be less than %u bytes!", (unsigned)limit);
+    response->send(413, "text/html", error);
+
+    /* Return failure to close underlying connection else the incoming body will keep the socket busy */
+    return ESP_FAIL;
+  }
+
+  // a streamed body stays on the socket for the parser
+  if (!_streamBody && request->loadBody() != ESP_OK)
+    return response->send(400, "text/html", "Error loading request body.");
+  request->loadParams(!_streamBody);
 
   if (_onRequest) {
+    PsychicJsonPool* pool = request->server()->getJsonPool();
+    bool msgPack = isMsgPackType(request->contentType());
 #ifdef ARDUINOJSON_6_COMPATIBILITY
-    DynamicJsonDocument jsonBuffer(this->_maxJsonBufferSize);
-    DeserializationError error = deserializeJson(jsonBuffer, request->body());
-    if (error)
-      return response->send(400);
-
-    JsonVariant json = jsonBuffer.as<JsonVariant>();
+    PsychicJsonDocument* jsonBuffer = pool->borrow(this->_maxJsonBufferSize);
+    JsonVariantConst filter;
 #else
-    JsonDocument jsonBuffer;
-    DeserializationError error = deserializeJson(jsonBuffer, request->body());
-    if (error)
-      return response->send(400);
-
-    JsonVariant json = jsonBuffer.as<JsonVariant>();
+    PsychicJsonDocument* jsonBuffer = pool->borrow();
+    JsonVariantConst filter = _jsonFilter.as<JsonVariantConst>();
 #endif
 
-    return _onRequest(request, response, json);
+    DeserializationError error;
+    if (_streamBody) {
+      PsychicRequestStream body(request, limit);
+      error = deserializeBody(*jsonBuffer, body, msgPack, filter);
+    } else
+      error = deserializeBody(*jsonBuffer, request->body(), msgPack, filter);
+
+    esp_err_t err;
+    if (error)
+      err = response->send(400);
+    else {
+      JsonVariant json = jsonBuffer->as<JsonVariant>();
+      err = _onRequest(request, response, json);
+    }
+
+    pool->release(jsonBuffer);
+    return err;
   } else
     return response->send(500);
-}
\ No newline at end of file
+}
@@ -9,7 +9,9 @@
 #define PSYCHIC_JSON_H_
 
 #include "ChunkPrinter.h"
+#include "PsychicJsonPool.h"
 #include "PsychicRequest.h"
+#include "PsychicRequestStream.h"
 #include "PsychicWebHandler.h"
 #include <ArduinoJson.h>
 
@@ -25,6 +27,7 @@
 #endif
 
 constexpr const char* JSON_MIMETYPE = "application/json";
+constexpr const char* MSGPACK_MIMETYPE = "application/msgpack";
 
 /*
  * Json Response
@@ -35,14 +38,15 @@ class PsychicJsonResponse : public PsychicResponseDelegate
   protected:
 #ifdef ARDUINOJSON_5_COMPATIBILITY
     DynamicJsonBuffer _jsonBuffer;
-#elif ARDUINOJSON_VERSION_MAJOR == 6
-    DynamicJsonDocument _jsonBuffer;
 #else
-    JsonDocument _jsonBuffer;
+    // borrowed from the server's pool, handed back in the destructor
+    PsychicJsonPool* _pool;
+    PsychicJsonDocument* _jsonBuffer;
 #endif
 
     JsonVariant _root;
     size_t _contentLength;
+    bool _msgPack;
 
   public:
 #ifdef ARDUINOJSON_5_COMPATIBILITY
@@ -53,13 +57,41 @@ class PsychicJsonResponse : public PsychicResponseDelegate
     PsychicJsonResponse(PsychicResponse* response, bool isArray = false);
 #endif
 
-    ~PsychicJsonResponse()
-    {
-    }
+    ~PsychicJsonResponse();
 
     JsonVariant& getRoot();
     size_t getLength();
 
+    // defaults to MessagePack when the client's Accept header asks for it
+    void setMsgPack(bool msgPack) { _msgPack = msgPack; }
+    bool isMsgPack() { return _msgPack; }
+
+    esp_err_t send();
+};
+
+/*
+ * Json Stream Response :: serializes one element at a time from a generator callback
+ * */
+
+enum PsychicJsonStreamFormat {
+  JSON_STREAM_ARRAY, // [{...},{...}]
+  JSON_STREAM_NDJSON // {...}\n{...}\n
+};
+
+constexpr const char* NDJSON_MIMETYPE = "application/x-ndjson";
+
+// fill doc with element number index and return true, or return false when there are no more
+typedef std::function<bool(size_t index, JsonDocument& doc)> PsychicJsonGenerator;
+
+class PsychicJsonStreamResponse : public PsychicResponseDelegate
+{
+  protected:
+    PsychicJsonGenerator _generator;
+    PsychicJsonStreamFormat _format;
+
+  public:
+    PsychicJsonStreamResponse(PsychicResponse* response, PsychicJsonGenerator generator, PsychicJsonStreamFormat format = JSON_STREAM_ARRAY);
+
     esp_err_t send();
 };
 
@@ -67,8 +99,12 @@ class PsychicJsonHandler : public PsychicWebHandler
 {
   protected:
     PsychicJsonRequestCallback _onRequest;
+    bool _streamBody = false;
+    size_t _maxStreamBodySize = 0; // 0 = the server's maxRequestBodySize
 #if ARDUINOJSON_VERSION_MAJOR == 6
     const size_t _maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE;
+#else
+    JsonDocument _jsonFilter;
 #endif
 
   public:
@@ -84,6 +120,16 @@ class PsychicJsonHandler : public PsychicWebHandler
 #endif
 
     void onRequest(PsychicJsonRequestCallback fn);
+
+    // parse the body straight off the socket instead of loading it into request->body() first
+    PsychicJsonHandler* setStreamBody(bool stream);
+    // bigger streamed bodies are answered with 413 (like buffered ones over maxRequestBodySize),
+    // the document grows as it parses so keep this bounded
+    PsychicJsonHandler* setMaxStreamBodySize(size_t size);
+#if ARDUINOJSON_VERSION_MAJOR != 6
+    // only materialize the fields present in filter, see ArduinoJson's DeserializationOption::Filter
+    PsychicJsonHandler* setJsonFilter(JsonVariantConst filter);
+#endif
     virtual esp_err_t handleRequest(PsychicRequest* request, PsychicResponse* response) override;
 };
 
@@ -0,0 +1,734 @@
+#ifndef PsychicJsonBinding_h
+#define PsychicJsonBinding_h
+
+#include "ChunkPrinter.h"
+#include "PsychicCore.h"
+#include "PsychicHttpServer.h"
+#include "PsychicJson.h"
+#include "PsychicRequest.h"
+#include "PsychicRequestStream.h"
+#include "PsychicResponse.h"
+#include "PsychicWebHandler.h"
+#include <limits>
+#include <type_traits>
+
+#ifndef JSON_BINDING_MAX_KEY
+  #define JSON_BINDING_MAX_KEY 32
+#endif
+
+#ifndef JSON_BINDING_MAX_DEPTH
+  #define JSON_BINDING_MAX_DEPTH 8
+#endif
+
+// stack buffer used by PsychicJsonBinding::send(), bigger documents go out chunked
+#ifndef JSON_BINDING_BUFFER_SIZE
+  #define JSON_BINDING_BUFFER_SIZE 512
+#endif
+
+/*
+ * PsychicJsonSchema :: describes the JSON fields of a struct, specialize it for your own types
+ *
+ *   struct Setpoint {
+ *     float target;
+ *     uint8_t zone;
+ *     char mode[8];
+ *   };
+ *
+ *   template <>
+ *   struct PsychicJsonSchema<Setpoint> {
+ *       template <typename V, typename S>
+ *       static void fields(V& v, S& s)
+ *       {
+ *         v("target", s.target);
+ *         v("zone", s.zone);
+ *         v("mode", s.mode);
+ *       }
+ *   };
+ *
+ * S is either Setpoint or const Setpoint, so the same description drives both parsing and serializing.
+ * Fields can be bool, any integer or floating point type, char[N], String, fixed arrays or other described structs.
+ */
+
+template <typename T>
+struct PsychicJsonSchema;
+
+/*
+ * PsychicJsonBufferReader :: lets the parser read from memory, anything with read() and peek() works
+ */
+
+class PsychicJsonBufferReader
+{
+  protected:
+    const char* _pos;
+    const char* _end;
+
+  public:
+    PsychicJsonBufferReader(const char* json, size_t len) : _pos(json), _end(json + len) {}
+
+    int read() { return _pos < _end ? (uint8_t)*_pos++ : -1; }
+    int peek() { return _pos < _end ? (uint8_t)*_pos : -1; }
+};
+
+/*
+ * PsychicJsonParser :: single pass, allocation free parser straight into a described struct
+ *
+ * Unknown keys are skipped, nulls leave the field untouched.
+ */
+
+template <typename TReader>
+class PsychicJsonParser
+{
+  protected:
+    TReader& _reader;
+    uint8_t _depth;
+
+    struct FieldVisitor {
+        PsychicJsonParser* parser;
+        const char* key;
+        bool found;
+        bool ok;
+
+        template <typename F>
+        void operator()(const char* name, F& field)
+        {
+          if (found || strcmp(name, key) != 0)
+            return;
+
+          found = true;
+          if (parser->_peek() == 'n')
+            ok = parser->_readLiteral("null");
+          else
+            ok = parser->read(field);
+        }
+    };
+
+    void _skipSpace()
+    {
+      int c = _reader.peek();
+      while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        _reader.read();
+        c = _reader.peek();
+      }
+    }
+
+    int _peek()
+    {
+      _skipSpace();
+      return _reader.peek();
+    }
+
+    bool _expect(char c)
+    {
+      _skipSpace();
+      return _reader.read() == c;
+    }
+
+    bool _readLiteral(const char* literal)
+    {
+      _skipSpace();
+      for (; *literal; literal++) {
+        if (_reader.read() != *literal)
+          return false;
+      }
+      return true;
+    }
+
+    // decodes into out, or appends to str, or just skips when both are NULL. returns false if it doesn't fit.
+    bool _readString(char* out, size_t size, String* str = NULL)
+    {
+      if (!_expect('"'))
+        return false;
+
+      size_t len = 0;
+      bool fits = true;
+      while (true) {
+        int c = _reader.read();
+        if (c < 0)
+          return false;
+        if (c == '"')
+          break;
+        // raw control characters have to be escaped
+        if (c < 0x20)
+          return false;
+
+        char utf8[4];
+        size_t count = 1;
+        utf8[0] = c;
+
+        if (c == '\\') {
+          c = _reader.read();
+          switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+              utf8[0] = c;
+              break;
+            case 'b':
+              utf8[0] = '\b';
+              break;
+            case 'f':
+              utf8[0] = '\f';
+              break;
+            case 'n':
+              utf8[0] = '\n';
+              break;
+            case 'r':
+              utf8[0] = '\r';
+              break;
+            case 't':
+              utf8[0] = '\t';
+              break;
+            case 'u': {
+              uint32_t cp;
+              if (!_readHex(cp))
+                return false;
+              // surrogate pair
+              if (cp >= 0xD800 && cp <= 0xDBFF) {
+                uint32_t low;
+                if (_reader.read() != '\\' || _reader.read() != 'u' || !_readHex(low))
+                  return false;
+                if (low < 0xDC00 || low > 0xDFFF)
+                  return false;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+              } else if (cp >= 0xDC00 && cp <= 0xDFFF)
+                return false; // low half on its own
+              count = _encodeUtf8(cp, utf8);
+              break;
+            }
+            default:
+              return false;
+          }
+        }
+
+        if (str != NULL)
+          str->concat(utf8, count);
+        else if (out != NULL) {
+          if (len + count < size) {
+            memcpy(out + len, utf8, count);
+            len += count;
+          } else
+            fits = false;
+        }
+      }
+
+      if (out != NULL && size > 0)
+        out[len] = '\0';
+      return fits;
+    }
+
+    bool _readHex(uint32_t& value)
+    {
+      value = 0;
+      for (int i = 0; i < 4; i++) {
+        int c = _reader.read();
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+          value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+          value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+          value |= c - 'A' + 10;
+        else
+          return false;
+      }
+      return true;
+    }
+
+    static size_t _encodeUtf8(uint32_t cp, char* out)
+    {
+      if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+      } else if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+      } else if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+      }
+      out[0] = 0xF0 | (cp >> 18);
+      out[1] = 0x80 | ((cp >> 12) & 0x3F);
+      out[2] = 0x80 | ((cp >> 6) & 0x3F);
+      out[3] = 0x80 | (cp & 0x3F);
+      return 4;
+    }
+
+    // copies the raw number text, the caller converts it
+    bool _readNumber(char* out, size_t size)
+    {
+      _skipSpace();
+
+      size_t len = 0;
+      int c = _reader.peek();
+      while ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+        if (len + 1 >= size)
+          return false;
+        out[len++] = _reader.read();
+        c = _reader.peek();
+      }
+      out[len] = '\0';
+      return len > 0;
+    }
+
+    bool _skipValue()
+    {
+      char number[32];
+      switch (_peek()) {
+        case '"':
+          return _readString(NULL, 0);
+        case 't':
+          return _readLiteral("true");
+        case 'f':
+          return _readLiteral("false");
+        case 'n':
+          return _readLiteral("null");
+        case '{':
+        case '[':
+          return _skipContainer();
+        default:
+          return _readNumber(number, sizeof(number));
+      }
+    }
+
+    bool _skipContainer()
+    {
+      if (++_depth > JSON_BINDING_MAX_DEPTH)
+        return false;
+
+      bool object = _reader.read() == '{';
+      char close = object ? '}' : ']';
+
+      if (_peek() == close) {
+        _reader.read();
+        _depth--;
+        return true;
+      }
+
+      while (true) {
+        if (object && (!_readString(NULL, 0) || !_expect(':')))
+          return false;
+        if (!_skipValue())
+          return false;
+
+        _skipSpace();
+        int c = _reader.read();
+        if (c == close)
+          break;
+        if (c != ',')
+          return false;
+      }
+
+      _depth--;
+      return true;
+    }
+
+    template <typename T>
+    bool _readArithmetic(T& value, std::true_type /* integral */)
+    {
+      char number[24];
+      if (!_readNumber(number, sizeof(number)))
+        return false;
+
+      char* end;
+      errno = 0;
+      if (std::is_signed<T>::value) {
+        long long result = strtoll(number, &end, 10);
+        if (*end || errno || result < (long long)std::numeric_limits<T>::min() || result > (long long)std::numeric_limits<T>::max())
+          return false;
+        value = (T)result;
+      } else {
+        unsigned long long result = strtoull(number, &end, 10);
+        if (*end || errno || number[0] == '-' || result > (unsigned long long)std::numeric_limits<T>::max())
+          return false;
+        value = (T)result;
+      }
+      return true;
+    }
+
+    template <typename T>
+    bool _readArithmetic(T& value, std::false_type /* floating point */)
+    {
+      char number[32];
+      if (!_readNumber(number, sizeof(number)))
+        return false;
+
+      char* end;
+      double result = strtod(number, &end);
+      if (*end)
+        return false;
+      value = (T)result;
+      return true;
+    }
+
+    template <typename T>
+    bool _read(T& value, std::true_type /* arithmetic */)
+    {
+      return _readArithmetic(value, std::is_integral<T>());
+    }
+
+    template <typename T>
+    bool _read(T& value, std::false_type /* described struct */)
+    {
+      if (!_expect('{'))
+        return false;
+      if (++_depth > JSON_BINDING_MAX_DEPTH)
+        return false;
+
+      if (_peek() == '}') {
+        _reader.read();
+        _depth--;
+        return true;
+      }
+
+      char key[JSON_BINDING_MAX_KEY];
+      while (true) {
+        // keys that don't fit can't match any field, so they just get skipped
+        bool fits = _readString(key, sizeof(key));
+        if (!_expect(':'))
+          return false;
+
+        FieldVisitor visitor = {this, key, false, true};
+        if (fits)
+          PsychicJsonSchema<T>::fields(visitor, value);
+        if (!visitor.ok || (!visitor.found && !_skipValue()))
+          return false;
+
+        _skipSpace();
+        int c = _reader.read();
+        if (c == '}')
+          break;
+        if (c != ',')
+          return false;
+      }
+
+      _depth--;
+      return true;
+    }
+
+  public:
+    PsychicJsonParser(TReader& reader) : _reader(reader), _depth(0) {}
+
+    // nothing but whitespace left after the value
+    bool atEnd() { return _peek() == -1; }
+
+    bool read(bool& value)
+    {
+      if (_peek() == 't')
+        return value = _readLiteral("true");
+      value = false;
+      return _readLiteral("false");
+    }
+
+    template <size_t N>
+    bool read(char (&value)[N])
+    {
+      return _readString(value, N);
+    }
+
+    bool read(String& value)
+    {
+      value = "";
+      return _readString(NULL, 0, &value);
+    }
+
+    template <typename E, size_t N>
+    bool read(E (&value)[N])
+    {
+      if (!_expect('['))
+        return false;
+
+      if (_peek() == ']') {
+        _reader.read();
+        return true;
+      }
+
+      for (size_t i = 0;; i++) {
+        if (i >= N || !read(value[i]))
+          return false;
+
+        _skipSpace();
+        int c = _reader.read();
+        if (c == ']')
+          return true;
+        if (c != ',')
+          return false;
+      }
+    }
+
+    template <typename T>
+    bool read(T& value)
+    {
+      return _read(value, std::is_arithmetic<T>());
+    }
+};
+
+/*
+ * PsychicJsonWriter :: serializes a described struct to any Print
+ */
+
+class PsychicJsonWriter
+{
+  protected:
+    Print& _out;
+    size_t _written;
+
+    struct FieldVisitor {
+        PsychicJsonWriter* writer;
+        bool first;
+
+        template <typename F>
+        void operator()(const char* name, F& field)
+        {
+          if (!first)
+            writer->_write(",", 1);
+          first = false;
+
+          writer->_writeString(name, strlen(name));
+          writer->_write(":", 1);
+          writer->write(field);
+        }
+    };
+
+    void _write(const char* data, size_t len)
+    {
+      _written += _out.write((const uint8_t*)data, len);
+    }
+
+    void _writeString(const char* str, size_t len)
+    {
+      _write("\"", 1);
+
+      // pass plain runs through in one go, escape the rest
+      size_t start = 0;
+      for (size_t i = 0; i < len; i++) {
+        uint8_t c = str[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+          continue;
+
+        _write(str + start, i - start);
+        start = i + 1;
+
+        char escaped[7];
+        switch (c) {
+          case '"':
+            _write("\\\"", 2);
+            break;
+          case '\\':
+            _write("\\\\", 2);
+            break;
+          case '\n':
+            _write("\\n", 2);
+            break;
+          case '\r':
+            _write("\\r", 2);
+            break;
+          case '\t':
+            _write("\\t", 2);
+            break;
+          default:
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            _write(escaped, 6);
+        }
+      }
+      _write(str + start, len - start);
+
+      _write("\"", 1);
+    }
+
+    template <typename T>
+    void _writeArithmetic(T value, std::true_type /* integral */)
+    {
+      char number[24];
+      int len;
+      if (std::is_signed<T>::value)
+        len = snprintf(number, sizeof(number), "%lld", (long long)value);
+      else
+        len = snprintf(number, sizeof(number), "%llu", (unsigned long long)value);
+      _write(number, len);
+    }
+
+    template <typename T>
+    void _writeArithmetic(T value, std::false_type /* floating point */)
+    {
+      // json has no nan or infinity
+      if (value != value || value - value != 0) {
+        _write("null", 4);
+        return;
+      }
+
+      char number[32];
+      int len = snprintf(number, sizeof(number), "%.*g", std::numeric_limits<T>::digits10 + 1, (double)value);
+      _write(number, len);
+    }
+
+    template <typename T>
+    void _write(const T& value, std::true_type /* arithmetic */)
+    {
+      _writeArithmetic(value, std::is_integral<T>());
+    }
+
+    template <typename T>
+    void _write(const T& value, std::false_type /* described struct */)
+    {
+      _write("{", 1);
+      FieldVisitor visitor = {this, true};
+      PsychicJsonSchema<T>::fields(visitor, value);
+      _write("}", 1);
+    }
+
+  public:
+    PsychicJsonWriter(Print& out) : _out(out), _written(0) {}
+
+    size_t written() { return _written; }
+
+    void write(bool value)
+    {
+      if (value)
+        _write("true", 4);
+      else
+        _write("false", 5);
+    }
+
+    template <size_t N>
+    void write(const char (&value)[N])
+    {
+      _writeString(value, strnlen(value, N));
+    }
+
+    void write(const String& value)
+    {
+      _writeString(value.c_str(), value.length());
+    }
+
+    template <typename E, size_t N>
+    void write(const E (&value)[N])
+    {
+      _write("[", 1);
+      for (size_t i = 0; i < N; i++) {
+        if (i > 0)
+          _write(",", 1);
+        write(value[i]);
+      }
+      _write("]", 1);
+    }
+
+    template <typename T>
+    void write(const T& value)
+    {
+      _write(value, std::is_arithmetic<T>());
+    }
+};
+
+/*
+ * PsychicJsonBinding :: the entry points for parsing and serializing described structs
+ */
+
+class PsychicJsonBinding
+{
+  protected:
+    // counts bytes instead of writing them
+    class Counter : public Print
+    {
+      public:
+        size_t write(uint8_t c) override { return 1; }
+        size_t write(const uint8_t* buffer, size_t size) override { return size; }
+    };
+
+  public:
+    template <typename T, typename TReader>
+    static bool parse(TReader& reader, T& value)
+    {
+      PsychicJsonParser<TReader> parser(reader);
+      return parser.read(value) && parser.atEnd();
+    }
+
+    template <typename T>
+    static bool parse(const char* json, size_t len, T& value)
+    {
+      PsychicJsonBufferReader reader(json, len);
+      return parse(reader, value);
+    }
+
+    template <typename T>
+    static size_t serialize(const T& value, Print& out)
+    {
+      PsychicJsonWriter writer(out);
+      writer.write(value);
+      return writer.written();
+    }
+
+    template <typename T>
+    static size_t measure(const T& value)
+    {
+      Counter counter;
+      return serialize(value, counter);
+    }
+
+    template <typename T>
+    static esp_err_t send(PsychicResponse* response, const T& value, int code = 200)
+    {
+      uint8_t buffer[JSON_BINDING_BUFFER_SIZE];
+
+      response->setCode(code);
+      response->setContentType(JSON_MIMETYPE);
+      response->sendHeaders();
+
+      // goes out as a single response unless it outgrows the buffer
+      ChunkPrinter dest(response, buffer, sizeof(buffer));
+      serialize(value, dest);
+      return dest.finish();
+    }
+};
+
+/*
+ * PsychicJsonBindingHandler :: parses the body straight off the socket into a T for a typed callback
+ *
+ * Normally created through server.on<T>(uri, method, callback).
+ */
+
+template <typename T>
+class PsychicJsonBindingHandler : public PsychicWebHandler
+{
+  protected:
+    PsychicJsonBindingCallback<T> _onRequest;
+
+  public:
+    PsychicJsonBindingHandler(PsychicJsonBindingCallback<T> onRequest) : _onRequest(onRequest) {}
+
+    esp_err_t handleRequest(PsychicRequest* request, PsychicResponse* response) override
+    {
+      // the body stays on the socket, so only the client bookkeeping is left
+      PsychicClient* client = checkForNewClient(request->client());
+      if (client->isNew)
+        openCallback(client);
+
+      // String members grow with the input, so the usual body limit still applies
+      size_t limit = request->server()->maxRequestBodySize;
+      if (request->contentLength() > limit) {
+        ESP_LOGE(PH_TAG, "Request body too large : %d bytes", request->contentLength());
+        response->send(413, "text/plain", "Request body too large");
+        return ESP_FAIL;
+      }
+
+      // the query string, the body stays on the socket for the parser
+      request->loadParams(false);
+
+      T value = T();
+      PsychicRequestStream body(request, limit);
+      if (!PsychicJsonBinding::parse(body, value))
+        return response->send(400, "text/plain", "Invalid JSON");
+
+      return _onRequest(request, response, value);
+    }
+};
+
+template <typename T>
+PsychicEndpoint* PsychicHttpServer::on(const char* uri, int method, PsychicJsonBindingCallback<T> fn)
+{
+  return on(uri, method, new PsychicJsonBindingHandler<T>(fn));
+}
+
+#endif // PsychicJsonBinding_h
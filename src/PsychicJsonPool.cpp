@@ -0,0 +1,115 @@
+#include "PsychicJsonPool.h"
+
+void* PsychicJsonAllocator::allocate(size_t size)
+{
+  void* ptr = heap_caps_malloc(size, _caps);
+  if (ptr == NULL)
+    ptr = malloc(size);
+  return ptr;
+}
+
+void PsychicJsonAllocator::deallocate(void* ptr)
+{
+  // heap_caps_free() handles any region, including plain malloc()
+  heap_caps_free(ptr);
+}
+
+void* PsychicJsonAllocator::reallocate(void* ptr, size_t new_size)
+{
+  void* result = heap_caps_realloc(ptr, new_size, _caps);
+  if (result == NULL)
+    result = realloc(ptr, new_size);
+  return result;
+}
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+PsychicJsonPool::PsychicJsonPool(size_t size, size_t capacity, uint32_t caps) : _free(NULL),
+                                                                                _size(size),
+                                                                                _allocator(caps),
+                                                                                _capacity(capacity),
+                                                                                _hits(0),
+                                                                                _misses(0)
+#else
+PsychicJsonPool::PsychicJsonPool(size_t size, uint32_t caps) : _free(NULL),
+                                                               _size(size),
+                                                               _allocator(caps),
+                                                               _hits(0),
+                                                               _misses(0)
+#endif
+{
+  if (_size > 0) {
+    _free = xQueueCreate(_size, sizeof(PsychicJsonDocument*));
+    if (_free == NULL) {
+      ESP_LOGE(PH_TAG, "Failed to create JSON pool queue");
+      _size = 0;
+    }
+  }
+}
+
+PsychicJsonPool::~PsychicJsonPool()
+{
+  if (_free == NULL)
+    return;
+
+  PsychicJsonDocument* doc;
+  while (xQueueReceive(_free, &doc, 0) == pdTRUE)
+    delete doc;
+  vQueueDelete(_free);
+}
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+PsychicJsonDocument* PsychicJsonPool::borrow(size_t capacity)
+{
+  PsychicJsonDocument* doc;
+  if (capacity <= _capacity && _free != NULL && xQueueReceive(_free, &doc, 0) == pdTRUE) {
+    _hits++;
+    return doc;
+  }
+
+  _misses++;
+  return new PsychicJsonDocument(capacity > _capacity ? capacity : _capacity, _allocator);
+}
+#else
+PsychicJsonDocument* PsychicJsonPool::borrow()
+{
+  PsychicJsonDocument* doc;
+  if (_free != NULL && xQueueReceive(_free, &doc, 0) == pdTRUE) {
+    _hits++;
+    return doc;
+  }
+
+  _misses++;
+  return new PsychicJsonDocument(&_allocator);
+}
+#endif
+
+void PsychicJsonPool::release(PsychicJsonDocument* doc)
+{
+  if (doc == NULL)
+    return;
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+  // oversized one-offs don't get to stick around
+  if (doc->capacity() != _capacity) {
+    delete doc;
+    return;
+  }
+#endif
+
+  doc->clear();
+  if (_free == NULL || xQueueSend(_free, &doc, 0) != pdTRUE)
+    delete doc;
+}
+
+size_t PsychicJsonPool::available()
+{
+  if (_free == NULL)
+    return 0;
+  return uxQueueMessagesWaiting(_free);
+}
+
+void PsychicJsonPool::resetStats()
+{
+  _hits = 0;
+  _misses = 0;
+}
@@ -0,0 +1,103 @@
+#ifndef PsychicJsonPool_h
+#define PsychicJsonPool_h
+
+#include "PsychicCore.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include <ArduinoJson.h>
+#include <atomic>
+#include <esp_heap_caps.h>
+
+#ifndef JSON_POOL_SIZE
+  #define JSON_POOL_SIZE 2
+#endif
+
+// where pooled documents get their memory from, PSRAM when the board has it
+#ifndef JSON_POOL_CAPS
+  #ifdef CONFIG_SPIRAM
+    #define JSON_POOL_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+  #else
+    #define JSON_POOL_CAPS MALLOC_CAP_DEFAULT
+  #endif
+#endif
+
+#if ARDUINOJSON_VERSION_MAJOR == 6 && !defined(DYNAMIC_JSON_DOCUMENT_SIZE)
+  #define DYNAMIC_JSON_DOCUMENT_SIZE 4096
+#endif
+
+/*
+ * PsychicJsonAllocator :: heap_caps backed allocator for ArduinoJson
+ *
+ * Falls back to the regular heap if the requested caps can't satisfy the allocation.
+ */
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+class PsychicJsonAllocator
+#else
+class PsychicJsonAllocator : public ArduinoJson::Allocator
+#endif
+{
+  protected:
+    uint32_t _caps;
+
+  public:
+    PsychicJsonAllocator(uint32_t caps = JSON_POOL_CAPS) : _caps(caps) {}
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr);
+    void* reallocate(void* ptr, size_t new_size);
+};
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+typedef BasicJsonDocument<PsychicJsonAllocator> PsychicJsonDocument;
+#else
+typedef JsonDocument PsychicJsonDocument;
+#endif
+
+/*
+ * PsychicJsonPool :: a small per-server stash of reusable JSON documents
+ *
+ * borrow() hands out a document from the pool (a hit) or a freshly built one (a miss),
+ * release() clears it and puts it back, or deletes it when the pool is already full.
+ * The pool fills up lazily, so it costs nothing until JSON is actually used.
+ * Safe to use from several tasks at once.
+ */
+
+class PsychicJsonPool
+{
+  protected:
+    QueueHandle_t _free;
+    size_t _size;
+    PsychicJsonAllocator _allocator;
+#if ARDUINOJSON_VERSION_MAJOR == 6
+    size_t _capacity;
+#endif
+
+    std::atomic<uint32_t> _hits;
+    std::atomic<uint32_t> _misses;
+
+  public:
+#if ARDUINOJSON_VERSION_MAJOR == 6
+    PsychicJsonPool(size_t size = JSON_POOL_SIZE, size_t capacity = DYNAMIC_JSON_DOCUMENT_SIZE, uint32_t caps = JSON_POOL_CAPS);
+#else
+    PsychicJsonPool(size_t size = JSON_POOL_SIZE, uint32_t caps = JSON_POOL_CAPS);
+#endif
+    ~PsychicJsonPool();
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+    // documents bigger than the pool capacity are never pooled
+    PsychicJsonDocument* borrow(size_t capacity = DYNAMIC_JSON_DOCUMENT_SIZE);
+    size_t capacity() { return _capacity; }
+#else
+    PsychicJsonDocument* borrow();
+#endif
+    void release(PsychicJsonDocument* doc);
+
+    size_t size() { return _size; }
+    size_t available();
+    uint32_t hits() { return _hits; }
+    uint32_t misses() { return _misses; }
+    void resetStats();
+};
+
+#endif // PsychicJsonPool_h
@@ -4,3 +4,20 @@ esp_err_t PsychicMiddlewareFunction::run(PsychicRequest* request, PsychicRespons
 {
   return _fn(request, request->response(), next);
 }
+
+PsychicMiddlewareNext::PsychicMiddlewareNext(PsychicMiddleware* const* middleware, size_t count, PsychicRequest* request, Finalizer finalizer, void* ctx) : _middleware(middleware),
+                                                                                                                                                        _count(count),
+                                                                                                                                                        _request(request),
+                                                                                                                                                        _finalizer(finalizer),
+                                                                                                                                                        _ctx(ctx)
+{
+}
+
+esp_err_t PsychicMiddlewareNext::operator()() const
+{
+  if (_count == 0)
+    return _finalizer ? _finalizer(_ctx) : HTTPD_404_NOT_FOUND;
+
+  PsychicMiddlewareNext rest(_middleware + 1, _count - 1, _request, _finalizer, _ctx);
+  return _middleware[0]->run(_request, _request->response(), rest);
+}
@@ -4,6 +4,8 @@
 #include "PsychicCore.h"
 #include "PsychicRequest.h"
 #include "PsychicResponse.h"
+#include <tuple>
+#include <type_traits>
 
 class PsychicMiddlewareChain;
 /*
@@ -34,4 +36,58 @@ class PsychicMiddlewareFunction : public PsychicMiddleware
     PsychicMiddlewareCallback _fn;
 };
 
+/*
+ * PsychicStaticMiddlewareChain - a chain fixed at compile time, eg.
+ *
+ *   PsychicStaticMiddlewareChain<LoggingMiddleware, CorsMiddleware, RateLimitMiddleware> chain;
+ *   chain.layer<2>().setRate(10);
+ *   server.addMiddleware(&chain);
+ *
+ * It is added as a single middleware and calls its layers directly instead of through the vtable,
+ * so the compiler can inline them.
+ * */
+
+template <typename... Layers>
+class PsychicStaticMiddlewareChain : public PsychicMiddleware
+{
+  protected:
+    typedef std::tuple<Layers...> layers_t;
+    layers_t _layers;
+
+    typedef struct {
+        PsychicStaticMiddlewareChain* chain;
+        PsychicRequest* request;
+        const PsychicMiddlewareNext* next;
+    } cursor_t;
+
+    template <size_t I>
+    static typename std::enable_if<(I < sizeof...(Layers)), esp_err_t>::type _step(void* ctx)
+    {
+      typedef typename std::tuple_element<I, layers_t>::type Layer;
+      cursor_t* cursor = (cursor_t*)ctx;
+      PsychicMiddlewareNext next(NULL, 0, cursor->request, &_step<I + 1>, ctx);
+      return std::get<I>(cursor->chain->_layers).Layer::run(cursor->request, cursor->request->response(), next);
+    }
+
+    // past the last layer, back to the chain we are part of
+    template <size_t I>
+    static typename std::enable_if<(I == sizeof...(Layers)), esp_err_t>::type _step(void* ctx)
+    {
+      return (*((cursor_t*)ctx)->next)();
+    }
+
+  public:
+    template <size_t I>
+    typename std::tuple_element<I, layers_t>::type& layer()
+    {
+      return std::get<I>(_layers);
+    }
+
+    esp_err_t run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next) override
+    {
+      cursor_t cursor = {this, request, &next};
+      return _step<0>(&cursor);
+    }
+};
+
 #endif
@@ -1,4 +1,5 @@
 #include "PsychicMiddlewareChain.h"
+#include <algorithm>
 
 PsychicMiddlewareChain::~PsychicMiddlewareChain()
 {
@@ -20,28 +21,22 @@ void PsychicMiddlewareChain::addMiddleware(PsychicMiddlewareCallback fn)
   _middleware.push_back(closure);
 }
 
+void PsychicMiddlewareChain::insertMiddleware(size_t index, PsychicMiddleware* middleware)
+{
+  _middleware.insert(_middleware.begin() + std::min(index, _middleware.size()), middleware);
+}
+
 void PsychicMiddlewareChain::removeMiddleware(PsychicMiddleware* middleware)
 {
-  _middleware.remove(middleware);
+  _middleware.erase(std::remove(_middleware.begin(), _middleware.end(), middleware), _middleware.end());
   if (middleware->_freeOnRemoval)
     delete middleware;
 }
 
-esp_err_t PsychicMiddlewareChain::runChain(PsychicRequest* request, PsychicMiddlewareNext finalizer)
+esp_err_t PsychicMiddlewareChain::runChain(PsychicRequest* request, PsychicMiddlewareNext::Finalizer finalizer, void* ctx)
 {
-  if (_middleware.size() == 0)
-    return finalizer();
+  if (_middleware.empty())
+    return finalizer(ctx);
 
-  PsychicMiddlewareNext next;
-  std::list<PsychicMiddleware*>::iterator it = _middleware.begin();
-
-  next = [this, &next, &it, request, finalizer]() {
-    if (it == _middleware.end())
-      return finalizer();
-    PsychicMiddleware* m = *it;
-    it++;
-    return m->run(request, request->response(), next);
-  };
-
-  return next();
-}
\ No newline at end of file
+  return PsychicMiddlewareNext(_middleware.data(), _middleware.size(), request, finalizer, ctx)();
+}
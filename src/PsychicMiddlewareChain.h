@@ -5,9 +5,14 @@
 #include "PsychicMiddleware.h"
 #include "PsychicRequest.h"
 #include "PsychicResponse.h"
+#include <type_traits>
+#include <vector>
 
 /*
  * PsychicMiddlewareChain - handle tracking and executing our chain of middleware objects
+ *
+ * The layers are kept in a vector and next() is a cursor into it, so running the chain costs one
+ * virtual call per layer and no allocations. Don't add or remove middleware while requests are running.
  * */
 
 class PsychicMiddlewareChain
@@ -17,12 +22,29 @@ class PsychicMiddlewareChain
 
     void addMiddleware(PsychicMiddleware* middleware);
     void addMiddleware(PsychicMiddlewareCallback fn);
+    // runs before the layer that is at index now
+    void insertMiddleware(size_t index, PsychicMiddleware* middleware);
     void removeMiddleware(PsychicMiddleware* middleware);
 
-    esp_err_t runChain(PsychicRequest* request, PsychicMiddlewareNext finalizer);
+    size_t size() { return _middleware.size(); }
+
+    esp_err_t runChain(PsychicRequest* request, PsychicMiddlewareNext::Finalizer finalizer, void* ctx);
+
+    // finalizer is any callable returning esp_err_t, it is called in place and never copied
+    template <typename F>
+    esp_err_t runChain(PsychicRequest* request, F&& finalizer)
+    {
+      return runChain(request, &_finalize<typename std::remove_reference<F>::type>, &finalizer);
+    }
 
   protected:
-    std::list<PsychicMiddleware*> _middleware;
+    std::vector<PsychicMiddleware*> _middleware;
+
+    template <typename F>
+    static esp_err_t _finalize(void* ctx)
+    {
+      return (*(F*)ctx)();
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
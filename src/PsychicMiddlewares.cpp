@@ -1,4 +1,6 @@
 #include "PsychicMiddlewares.h"
+#include "PsychicHttpServer.h"
+#include <algorithm>
 
 void LoggingMiddleware::setOutput(Print &output) {
   _out = &output;
@@ -168,3 +170,308 @@ esp_err_t CorsMiddleware::run(PsychicRequest* request, PsychicResponse* response
   }
   return next();
 }
+
+RateLimitMiddleware& RateLimitMiddleware::setRate(uint32_t tokens, uint32_t period_ms, uint32_t burst)
+{
+  _limiter.setRate(tokens, period_ms, burst);
+  return *this;
+}
+
+RateLimitMiddleware& RateLimitMiddleware::setKey(PsychicRateLimitKey key, const char* header)
+{
+  _key = key;
+  _header = header;
+  return *this;
+}
+
+uint32_t RateLimitMiddleware::keyFor(PsychicRequest* request)
+{
+  if (_key == RATE_LIMIT_BY_ROUTE)
+    return PsychicRateLimiter::hash(request->path().c_str());
+
+  if (_key == RATE_LIMIT_BY_HEADER && request->hasHeader(_header.c_str()))
+    return PsychicRateLimiter::hash(request->header(_header.c_str()).c_str());
+
+  return PsychicRateLimiter::hash(request->client()->remoteAddress());
+}
+
+esp_err_t RateLimitMiddleware::run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next)
+{
+  static const char body[] = "Too many requests, slow down.";
+
+  uint32_t retryAfter = 1;
+  if (_limiter.consume(keyFor(request), 1, &retryAfter))
+    return next();
+
+  char retry[12];
+  snprintf(retry, sizeof(retry), "%" PRIu32, retryAfter);
+
+  response->setCode(429);
+  response->setContentType("text/plain");
+  response->addHeader("Retry-After", retry);
+  response->setContent((const uint8_t*)body, sizeof(body) - 1);
+  return response->send();
+}
+
+ResponseCacheMiddleware& ResponseCacheMiddleware::setTTL(uint32_t ttl_ms)
+{
+  _ttl = ttl_ms;
+  return *this;
+}
+
+ResponseCacheMiddleware& ResponseCacheMiddleware::addQueryParam(const char* name)
+{
+  _params.push_back(name);
+  return *this;
+}
+
+ResponseCacheMiddleware& ResponseCacheMiddleware::addVary(const char* header)
+{
+  _vary.push_back(header);
+  return *this;
+}
+
+ResponseCacheMiddleware& ResponseCacheMiddleware::addTag(const char* tag)
+{
+  _tags.push_back(tag);
+  return *this;
+}
+
+String ResponseCacheMiddleware::keyFor(PsychicRequest* request)
+{
+  return PsychicResponseCache::key(request, _params, _vary);
+}
+
+esp_err_t ResponseCacheMiddleware::run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next)
+{
+  if (request->method() != HTTP_GET)
+    return next();
+
+  String key = keyFor(request);
+
+  PsychicResponseCache::entry_ptr entry = _cache->find(key, request);
+  if (entry)
+    return PsychicResponseCache::send(*entry, response);
+
+  // copy the body as the handler sends it
+  PsychicResponseCapture capture(RESPONSE_CACHE_MAX_ENTRY);
+  response->setCapture(&capture);
+
+  esp_err_t ret = next();
+
+  // the handler swapped the response out, nothing we can cache
+  if (request->response() != response)
+    return ret;
+
+  response->setCapture(NULL);
+
+  if (ret == ESP_OK && capture.complete && response->getCode() == 200 && PsychicResponseCache::isShareable(request, response))
+    _cache->store(key, request, response, capture.body, _ttl, _tags);
+
+  return ret;
+}
+
+SingleFlightMiddleware::SingleFlightMiddleware()
+{
+  _lock = xSemaphoreCreateMutex();
+}
+
+SingleFlightMiddleware::~SingleFlightMiddleware()
+{
+  for (auto* flight : _flights)
+    delete flight;
+  _flights.clear();
+  vSemaphoreDelete(_lock);
+}
+
+SingleFlightMiddleware& SingleFlightMiddleware::setTimeout(uint32_t timeout_ms)
+{
+  _timeout = timeout_ms;
+  return *this;
+}
+
+SingleFlightMiddleware& SingleFlightMiddleware::setLinger(uint32_t linger_ms)
+{
+  _linger = linger_ms;
+  return *this;
+}
+
+SingleFlightMiddleware& SingleFlightMiddleware::addQueryParam(const char* name)
+{
+  _params.push_back(name);
+  return *this;
+}
+
+SingleFlightMiddleware& SingleFlightMiddleware::addVary(const char* header)
+{
+  _vary.push_back(header);
+  return *this;
+}
+
+void SingleFlightMiddleware::_fanOut(std::vector<PsychicDeferredRequest*>& waiters, PsychicResponseCache::entry_ptr result)
+{
+  for (auto* waiter : waiters) {
+    waiter->send([this, result](PsychicRequest* request, PsychicResponse* response) {
+      if (result && PsychicResponseCache::varyMatches(*result, request))
+        return PsychicResponseCache::send(*result, response);
+
+      // nothing we could share (too big, not a 200, a cookie, different Vary headers...), run it for them instead
+      return _rerun(request);
+    });
+  }
+}
+
+esp_err_t SingleFlightMiddleware::_rerun(PsychicRequest* request)
+{
+  httpd_req_t* req = request->request();
+
+  // from the top, and straight past us this time
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _rerunning.push_back(req);
+  xSemaphoreGive(_lock);
+
+  esp_err_t err = PsychicHttpServer::requestHandler(req);
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _rerunning.erase(std::find(_rerunning.begin(), _rerunning.end(), req));
+  xSemaphoreGive(_lock);
+
+  return err;
+}
+
+esp_err_t SingleFlightMiddleware::run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next)
+{
+  if (request->method() != HTTP_GET)
+    return next();
+
+  // the answer depends on what this client already has, it can't be shared either way
+  if (request->hasHeader("If-None-Match") || request->hasHeader("If-Modified-Since"))
+    return next();
+
+  // an authenticated response is never shared, so there is nothing to wait for
+  if (request->hasHeader("Authorization"))
+    return next();
+
+  String key = PsychicResponseCache::key(request, _params, _vary);
+  unsigned long now = millis();
+  flight_t* flight = NULL;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+
+  // a waiter we are running again after the flight had nothing for it
+  if (std::find(_rerunning.begin(), _rerunning.end(), request->request()) != _rerunning.end()) {
+    xSemaphoreGive(_lock);
+    return next();
+  }
+
+  for (auto it = _flights.begin(); it != _flights.end();) {
+    flight_t* f = *it;
+
+    // done and no longer lingering
+    if (f->done && now - f->finishedAt >= _linger) {
+      delete f;
+      it = _flights.erase(it);
+      continue;
+    }
+
+    if (f->key.equals(key))
+      flight = f;
+    it++;
+  }
+
+  if (flight != NULL) {
+    // just finished, hand out the same response if it was for the same Vary headers
+    if (flight->done) {
+      PsychicResponseCache::entry_ptr result = flight->result;
+      xSemaphoreGive(_lock);
+      if (!PsychicResponseCache::varyMatches(*result, request))
+        return next();
+      _coalesced++;
+      return PsychicResponseCache::send(*result, response);
+    }
+
+    // still running, wait for it without holding up this task
+    PsychicDeferredRequest* waiter = request->defer(_timeout);
+    if (waiter != NULL) {
+      flight->waiters.push_back(waiter);
+      _coalesced++;
+      xSemaphoreGive(_lock);
+      return ESP_OK;
+    }
+
+    // couldn't park it, run it ourselves
+    xSemaphoreGive(_lock);
+    return next();
+  }
+
+  flight = new flight_t();
+  flight->key = key;
+  flight->done = false;
+  _flights.push_back(flight);
+
+  xSemaphoreGive(_lock);
+
+  // we are the one computing it
+  PsychicResponseCapture capture(SINGLE_FLIGHT_MAX_BODY);
+  response->setCapture(&capture);
+
+  esp_err_t ret = next();
+
+  PsychicResponseCache::entry_ptr result;
+  if (request->response() == response) {
+    response->setCapture(NULL);
+    if (ret == ESP_OK && capture.complete && response->getCode() == 200 && PsychicResponseCache::isShareable(request, response))
+      result = PsychicResponseCache::capture(key, request, response, capture.body);
+  }
+
+  std::vector<PsychicDeferredRequest*> waiters;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  waiters.swap(flight->waiters);
+  flight->result = result;
+  flight->finishedAt = millis();
+  flight->done = true;
+
+  // nothing to linger with
+  if (!result || !_linger) {
+    _flights.remove(flight);
+    delete flight;
+  }
+  xSemaphoreGive(_lock);
+
+  _fanOut(waiters, result);
+
+  return ret;
+}
+
+ETagMiddleware& ETagMiddleware::setVersion(PsychicETagVersionCallback fn)
+{
+  _version = fn;
+  return *this;
+}
+
+esp_err_t ETagMiddleware::run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next)
+{
+  if (request->method() != HTTP_GET && request->method() != HTTP_HEAD)
+    return next();
+
+  // cheap path, no need to render anything to know if it changed
+  if (_version) {
+    String version = _version(request);
+    if (version.length()) {
+      String etag = PsychicResponse::makeETag(version);
+      response->addHeader("ETag", etag.c_str());
+      if (PsychicResponse::matchesETag(request->header("If-None-Match"), etag))
+        return response->sendNotModified();
+      return next();
+    }
+  }
+
+  response->setAutoETag(true);
+  esp_err_t ret = next();
+
+  if (request->response() == response)
+    response->setAutoETag(false);
+
+  return ret;
+}
@@ -1,11 +1,24 @@
 #ifndef PsychicMiddlewares_h
 #define PsychicMiddlewares_h
 
+#include "PsychicDeferredRequest.h"
 #include "PsychicMiddleware.h"
+#include "PsychicRateLimiter.h"
+#include "PsychicResponseCache.h"
 
 #include <Stream.h>
 #include <http_status.h>
 
+// how long a coalesced request waits for the one computing its response before it gets a 504
+#ifndef SINGLE_FLIGHT_TIMEOUT
+  #define SINGLE_FLIGHT_TIMEOUT 10000
+#endif
+
+// biggest response that can be handed to the waiting requests
+#ifndef SINGLE_FLIGHT_MAX_BODY
+  #define SINGLE_FLIGHT_MAX_BODY (8 * 1024)
+#endif
+
 // curl-like logging middleware
 class LoggingMiddleware : public PsychicMiddleware
 {
@@ -75,4 +88,123 @@ class CorsMiddleware : public PsychicMiddleware
     uint32_t _maxAge = 86400;
 };
 
+// what a rate limit is counted against
+enum PsychicRateLimitKey {
+  RATE_LIMIT_BY_IP,    // each client address, the default
+  RATE_LIMIT_BY_ROUTE, // each path, shared by every client
+  RATE_LIMIT_BY_HEADER // each value of a header such as an API key, falls back to the IP without one
+};
+
+// answers 429 + Retry-After once a key runs out of tokens, attach it per endpoint for per route limits
+class RateLimitMiddleware : public PsychicMiddleware
+{
+  public:
+    RateLimitMiddleware(size_t size = RATE_LIMIT_TABLE_SIZE) : _limiter(size) {}
+
+    RateLimitMiddleware& setRate(uint32_t tokens, uint32_t period_ms = 1000, uint32_t burst = 0);
+    RateLimitMiddleware& setKey(PsychicRateLimitKey key, const char* header = "X-API-Key");
+
+    // share this with a PsychicWebSocketHandler to count frames against the same buckets
+    PsychicRateLimiter& limiter() { return _limiter; }
+
+    uint32_t keyFor(PsychicRequest* request);
+
+    esp_err_t run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next) override;
+
+  private:
+    PsychicRateLimiter _limiter;
+    PsychicRateLimitKey _key = RATE_LIMIT_BY_IP;
+    String _header;
+};
+
+// answers repeated GETs from a PsychicResponseCache for a while without calling the handler,
+// attach one per route to give each its own ttl and key. a hit is replayed as is, so an
+// ETagMiddleware has to be added before this one to see it.
+class ResponseCacheMiddleware : public PsychicMiddleware
+{
+  public:
+    ResponseCacheMiddleware(PsychicResponseCache* cache, uint32_t ttl_ms = 1000) : _cache(cache), _ttl(ttl_ms) {}
+
+    ResponseCacheMiddleware& setTTL(uint32_t ttl_ms);
+    // key on just these query params, by default it is the whole query string
+    ResponseCacheMiddleware& addQueryParam(const char* name);
+    // key on these request headers as well, on top of whatever the response's Vary names
+    ResponseCacheMiddleware& addVary(const char* header);
+    // entries from this route can be dropped with cache->invalidate(tag)
+    ResponseCacheMiddleware& addTag(const char* tag);
+
+    String keyFor(PsychicRequest* request);
+
+    esp_err_t run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next) override;
+
+  private:
+    PsychicResponseCache* _cache;
+    uint32_t _ttl;
+    std::vector<String> _params;
+    std::vector<String> _vary;
+    std::vector<String> _tags;
+};
+
+// identical GETs that come in while one is being handled wait for it (deferred, off the httpd task)
+// and all get its response, so a burst costs one run of the handler. Requests only overlap when
+// the endpoint is offloaded to the workers, setLinger() also covers ones handled back to back.
+// only 200s are shared, waiters that can't have the response are run again themselves. conditional
+// (If-None-Match, If-Modified-Since) and authenticated requests always run alone.
+class SingleFlightMiddleware : public PsychicMiddleware
+{
+  public:
+    SingleFlightMiddleware();
+    ~SingleFlightMiddleware();
+
+    SingleFlightMiddleware& setTimeout(uint32_t timeout_ms);
+    // keep handing out the last response for this long after it was sent
+    SingleFlightMiddleware& setLinger(uint32_t linger_ms);
+    // key on just these query params, by default it is the whole query string
+    SingleFlightMiddleware& addQueryParam(const char* name);
+    // key on these request headers as well, eg. Accept
+    SingleFlightMiddleware& addVary(const char* header);
+
+    uint32_t coalesced() { return _coalesced; }
+
+    esp_err_t run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next) override;
+
+  private:
+    typedef struct {
+        String key;
+        std::vector<PsychicDeferredRequest*> waiters;
+        PsychicResponseCache::entry_ptr result; // set once done, kept while lingering
+        unsigned long finishedAt;
+        bool done;
+    } flight_t;
+
+    std::list<flight_t*> _flights;
+    SemaphoreHandle_t _lock;
+    uint32_t _timeout = SINGLE_FLIGHT_TIMEOUT;
+    uint32_t _linger = 0;
+    std::vector<String> _params;
+    std::vector<String> _vary;
+    std::vector<httpd_req_t*> _rerunning; // waiters going through the server again, they skip us
+    uint32_t _coalesced = 0;
+
+    void _fanOut(std::vector<PsychicDeferredRequest*>& waiters, PsychicResponseCache::entry_ptr result);
+    esp_err_t _rerun(PsychicRequest* request);
+};
+
+// returns whatever changes when the response would, eg. a settings revision counter
+typedef std::function<String(PsychicRequest* request)> PsychicETagVersionCallback;
+
+// ETags for dynamic GETs, and 304 with no body when the client already has that version. By default
+// the body is hashed as it goes out (single piece bodies only, chunked ones are already on their way).
+// With setVersion() the tag comes from the version instead and a match never calls the handler.
+class ETagMiddleware : public PsychicMiddleware
+{
+  public:
+    ETagMiddleware& setVersion(PsychicETagVersionCallback fn);
+
+    esp_err_t run(PsychicRequest* request, PsychicResponse* response, PsychicMiddlewareNext next) override;
+
+  private:
+    PsychicETagVersionCallback _version;
+};
+
 #endif
@@ -0,0 +1,184 @@
+#include "PsychicPipeResponse.h"
+
+/*****************************************/
+// PsychicPipe
+/*****************************************/
+
+PsychicPipe::PsychicPipe(size_t capacity, PsychicPipePolicy policy, uint32_t writeTimeout_ms) : _size(capacity + 1),
+                                                                                               _head(0),
+                                                                                               _tail(0),
+                                                                                               _closed(false),
+                                                                                               _aborted(false),
+                                                                                               _dropped(0),
+                                                                                               _policy(policy),
+                                                                                               _writeTimeout(pdMS_TO_TICKS(writeTimeout_ms))
+{
+  // one slot always stays empty so full and empty can be told apart
+  _buffer = (uint8_t*)malloc(_size);
+  if (_buffer == NULL) {
+    ESP_LOGE(PH_TAG, "Unable to allocate %" PRIu32 " bytes for pipe", _size);
+    _size = 1;
+    _aborted = true;
+  }
+
+  _dataReady = xSemaphoreCreateBinary();
+  _spaceReady = xSemaphoreCreateBinary();
+}
+
+PsychicPipe::~PsychicPipe()
+{
+  free(_buffer);
+  vSemaphoreDelete(_dataReady);
+  vSemaphoreDelete(_spaceReady);
+}
+
+size_t PsychicPipe::available() const
+{
+  size_t head = _head.load(std::memory_order_acquire);
+  size_t tail = _tail.load(std::memory_order_acquire);
+  return (head + _size - tail) % _size;
+}
+
+size_t PsychicPipe::space() const
+{
+  return _size - 1 - available();
+}
+
+size_t PsychicPipe::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t PsychicPipe::write(const uint8_t* buffer, size_t size)
+{
+  if (_aborted || _closed)
+    return 0;
+
+  // drop the whole write so records stay intact
+  if (_policy == PIPE_DROP && space() < size) {
+    _dropped += size;
+    return 0;
+  }
+
+  size_t written = 0;
+  while (written < size) {
+    size_t free = space();
+    if (free == 0) {
+      if (xSemaphoreTake(_spaceReady, _writeTimeout) != pdTRUE || _aborted)
+        break;
+      continue;
+    }
+
+    size_t head = _head.load(std::memory_order_relaxed);
+    size_t len = std::min(free, size - written);
+
+    // copy in at most two spans, around the end of the ring
+    size_t first = std::min(len, _size - head);
+    memcpy(_buffer + head, buffer + written, first);
+    memcpy(_buffer, buffer + written + first, len - first);
+
+    _head.store((head + len) % _size, std::memory_order_release);
+    written += len;
+
+    xSemaphoreGive(_dataReady);
+  }
+
+  return written;
+}
+
+void PsychicPipe::close()
+{
+  _closed = true;
+  xSemaphoreGive(_dataReady);
+}
+
+const uint8_t* PsychicPipe::peek(size_t& len)
+{
+  size_t head = _head.load(std::memory_order_acquire);
+  size_t tail = _tail.load(std::memory_order_relaxed);
+
+  len = head >= tail ? head - tail : _size - tail;
+  return _buffer + tail;
+}
+
+void PsychicPipe::consume(size_t len)
+{
+  size_t tail = _tail.load(std::memory_order_relaxed);
+  _tail.store((tail + len) % _size, std::memory_order_release);
+
+  xSemaphoreGive(_spaceReady);
+}
+
+bool PsychicPipe::waitForData(uint32_t timeout_ms)
+{
+  if (available() || _closed)
+    return true;
+
+  xSemaphoreTake(_dataReady, pdMS_TO_TICKS(timeout_ms));
+  return available() || _closed;
+}
+
+void PsychicPipe::abort()
+{
+  _aborted = true;
+  xSemaphoreGive(_spaceReady);
+}
+
+/*****************************************/
+// PsychicPipeResponse
+/*****************************************/
+
+PsychicPipeResponse::PsychicPipeResponse(PsychicResponse* response, const String& contentType, PsychicPipe* pipe)
+    : PsychicStreamResponse(response, contentType), _pipe(pipe), _idleTimeout(10000)
+{
+}
+
+PsychicPipeResponse::PsychicPipeResponse(PsychicResponse* response, const String& contentType, const String& name, PsychicPipe* pipe)
+    : PsychicStreamResponse(response, contentType, name), _pipe(pipe), _idleTimeout(10000)
+{
+}
+
+esp_err_t PsychicPipeResponse::send()
+{
+  esp_err_t err = beginSend();
+  if (err != ESP_OK) {
+    _pipe->abort();
+    return err;
+  }
+
+  while (true) {
+    size_t len;
+    const uint8_t* data = _pipe->peek(len);
+
+    if (len) {
+      size_t sent = write(data, len);
+      _pipe->consume(len);
+
+      // client went away
+      if (sent != len) {
+        err = ESP_FAIL;
+        break;
+      }
+      continue;
+    }
+
+    // the producer is done and everything is out
+    if (_pipe->isClosed() && _pipe->available() == 0)
+      break;
+
+    // nothing buffered, so push out what we have while we wait
+    flush();
+
+    if (!_pipe->waitForData(_idleTimeout)) {
+      ESP_LOGE(PH_TAG, "Pipe producer timed out");
+      err = ESP_ERR_TIMEOUT;
+      break;
+    }
+  }
+
+  if (err != ESP_OK)
+    _pipe->abort();
+
+  esp_err_t end = endSend();
+  return err == ESP_OK ? end : err;
+}
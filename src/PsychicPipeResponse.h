@@ -0,0 +1,81 @@
+#ifndef PsychicPipeResponse_h
+#define PsychicPipeResponse_h
+
+#include "PsychicCore.h"
+#include "PsychicStreamResponse.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <atomic>
+
+/*
+ * PsychicPipe :: bounded single producer / single consumer byte ring
+ *
+ * The producer task prints into it, a PsychicPipeResponse drains it into a chunked response.
+ * Indices are lock free, the semaphores are only used to wake a waiting side up.
+ * Keep the pipe alive until both sides are done with it.
+ */
+
+enum PsychicPipePolicy {
+  PIPE_BLOCK, // producer waits for room (up to the write timeout)
+  PIPE_DROP   // a write that doesn't fit is dropped whole
+};
+
+class PsychicPipe : public Print
+{
+  protected:
+    uint8_t* _buffer;
+    size_t _size;
+    std::atomic<size_t> _head; // written by the producer
+    std::atomic<size_t> _tail; // written by the consumer
+    std::atomic<bool> _closed;
+    std::atomic<bool> _aborted;
+    std::atomic<uint32_t> _dropped;
+
+    PsychicPipePolicy _policy;
+    TickType_t _writeTimeout;
+
+    SemaphoreHandle_t _dataReady;
+    SemaphoreHandle_t _spaceReady;
+
+  public:
+    PsychicPipe(size_t capacity, PsychicPipePolicy policy = PIPE_BLOCK, uint32_t writeTimeout_ms = 1000);
+    ~PsychicPipe();
+
+    // producer side
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void close(); // no more data, the response finishes once drained
+
+    // consumer side
+    const uint8_t* peek(size_t& len); // longest contiguous readable span
+    void consume(size_t len);
+    bool waitForData(uint32_t timeout_ms);
+    void abort(); // client is gone, further writes fail straight away
+
+    size_t capacity() const { return _size - 1; }
+    size_t available() const;
+    size_t space() const;
+    bool isClosed() const { return _closed; }
+    bool isAborted() const { return _aborted; }
+    uint32_t dropped() const { return _dropped; } // bytes thrown away by PIPE_DROP
+};
+
+class PsychicPipeResponse : public PsychicStreamResponse
+{
+  protected:
+    PsychicPipe* _pipe;
+    uint32_t _idleTimeout;
+
+  public:
+    PsychicPipeResponse(PsychicResponse* response, const String& contentType, PsychicPipe* pipe);
+    PsychicPipeResponse(PsychicResponse* response, const String& contentType, const String& name, PsychicPipe* pipe); // Download
+
+    // give up if the producer goes quiet for this long
+    void setIdleTimeout(uint32_t ms) { _idleTimeout = ms; }
+
+    // blocks the calling task until the pipe is closed and drained
+    esp_err_t send();
+};
+
+#endif // PsychicPipeResponse_h
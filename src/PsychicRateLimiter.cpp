@@ -0,0 +1,152 @@
+#include "PsychicRateLimiter.h"
+#include "PsychicClient.h"
+
+PsychicRateLimiter::PsychicRateLimiter(size_t size) : _size(size),
+                                                      _tokens(10),
+                                                      _period(1000),
+                                                      _burst(10),
+                                                      _allowed(0),
+                                                      _limited(0),
+                                                      _evicted(0)
+{
+  if (_size == 0)
+    _size = 1;
+
+  _buckets = (bucket_t*)calloc(_size, sizeof(bucket_t));
+  if (_buckets == NULL) {
+    ESP_LOGE(PH_TAG, "Failed to allocate %d rate limit buckets", (int)_size);
+    _size = 0;
+  }
+
+  _lock = xSemaphoreCreateMutex();
+}
+
+PsychicRateLimiter::~PsychicRateLimiter()
+{
+  free(_buckets);
+  vSemaphoreDelete(_lock);
+}
+
+PsychicRateLimiter* PsychicRateLimiter::setRate(uint32_t tokens, uint32_t period_ms, uint32_t burst)
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _tokens = tokens;
+  _period = period_ms ? period_ms : 1;
+  _burst = burst ? burst : tokens;
+  xSemaphoreGive(_lock);
+
+  return this;
+}
+
+void PsychicRateLimiter::_refill(bucket_t* bucket, uint32_t now)
+{
+  uint64_t add = (uint64_t)(now - bucket->updated) * _tokens * 1000 / _period;
+
+  // keep the remainder for next time instead of rounding it away
+  if (add == 0)
+    return;
+
+  uint64_t tokens = bucket->tokens + add;
+  uint64_t full = (uint64_t)_burst * 1000;
+  bucket->tokens = tokens > full ? full : tokens;
+  bucket->updated = now;
+}
+
+PsychicRateLimiter::bucket_t* PsychicRateLimiter::_find(uint32_t key, uint32_t now)
+{
+  size_t start = key % _size;
+  size_t probes = _size < RATE_LIMIT_MAX_PROBE ? _size : RATE_LIMIT_MAX_PROBE;
+  bucket_t* victim = NULL;
+
+  // slots are only ever reused, never emptied, so the first empty one ends the search
+  for (size_t i = 0; i < probes; i++) {
+    bucket_t* bucket = &_buckets[(start + i) % _size];
+
+    if (bucket->key == key)
+      return bucket;
+
+    if (bucket->key == 0) {
+      victim = bucket;
+      break;
+    }
+
+    if (victim == NULL || now - bucket->updated > now - victim->updated)
+      victim = bucket;
+  }
+
+  if (victim->key != 0)
+    _evicted++;
+
+  victim->key = key;
+  victim->tokens = _burst * 1000;
+  victim->updated = now;
+
+  return victim;
+}
+
+bool PsychicRateLimiter::consume(uint32_t key, uint32_t cost, uint32_t* retry_after)
+{
+  // no rate, no limit
+  if (_tokens == 0 || _size == 0)
+    return true;
+
+  // 0 marks an empty slot
+  if (key == 0)
+    key = 1;
+
+  uint32_t now = millis();
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+
+  bucket_t* bucket = _find(key, now);
+  _refill(bucket, now);
+
+  uint32_t needed = cost * 1000;
+  if (bucket->tokens >= needed) {
+    bucket->tokens -= needed;
+    _allowed++;
+    xSemaphoreGive(_lock);
+    return true;
+  }
+
+  if (retry_after != NULL) {
+    uint64_t ms = ((uint64_t)(needed - bucket->tokens) * _period + _tokens * 1000 - 1) / ((uint64_t)_tokens * 1000);
+    *retry_after = ms < 1000 ? 1 : (uint32_t)((ms + 999) / 1000);
+  }
+
+  _limited++;
+  xSemaphoreGive(_lock);
+  return false;
+}
+
+void PsychicRateLimiter::reset()
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_buckets != NULL)
+    memset(_buckets, 0, _size * sizeof(bucket_t));
+  xSemaphoreGive(_lock);
+}
+
+// FNV-1a
+uint32_t PsychicRateLimiter::hash(const void* data, size_t len, uint32_t seed)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint32_t h = seed;
+  for (size_t i = 0; i < len; i++) {
+    h ^= bytes[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+uint32_t PsychicRateLimiter::hash(const char* str, uint32_t seed)
+{
+  return hash(str, strlen(str), seed);
+}
+
+uint32_t PsychicRateLimiter::hash(const PsychicSocketAddress& address)
+{
+  if (address.ipv6)
+    return hash(address.v6, sizeof(address.v6));
+  return hash(&address.v4, sizeof(address.v4));
+}
@@ -0,0 +1,79 @@
+#ifndef PsychicRateLimiter_h
+#define PsychicRateLimiter_h
+
+#include "PsychicCore.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// how many keys a limiter tracks at once, the least recently seen one is evicted past that
+#ifndef RATE_LIMIT_TABLE_SIZE
+  #define RATE_LIMIT_TABLE_SIZE 32
+#endif
+
+// how many slots a key may land away from its hash before we evict instead of probing further
+#ifndef RATE_LIMIT_MAX_PROBE
+  #define RATE_LIMIT_MAX_PROBE 8
+#endif
+
+struct PsychicSocketAddress;
+
+/*
+ * PsychicRateLimiter :: token buckets keyed by a 32 bit hash, in one fixed block of memory
+ *
+ * Every key gets up to burst tokens which refill at tokens per period_ms, and each consume()
+ * takes one. The buckets live in an open addressing table that never grows: once the probe
+ * window for a key is full the least recently seen bucket in it is reused, which is harmless
+ * since an idle bucket has refilled anyway. Keys that hash the same share a bucket.
+ *
+ * One limiter can be shared by a RateLimitMiddleware and a PsychicWebSocketHandler.
+ */
+
+class PsychicRateLimiter
+{
+  protected:
+    typedef struct {
+        uint32_t key;     // 0 = empty
+        uint32_t tokens;  // in thousandths of a token
+        uint32_t updated; // millis() of the last refill
+    } bucket_t;
+
+    bucket_t* _buckets;
+    size_t _size;
+    SemaphoreHandle_t _lock;
+
+    uint32_t _tokens;
+    uint32_t _period;
+    uint32_t _burst;
+
+    uint32_t _allowed;
+    uint32_t _limited;
+    uint32_t _evicted;
+
+    bucket_t* _find(uint32_t key, uint32_t now);
+    void _refill(bucket_t* bucket, uint32_t now);
+
+  public:
+    PsychicRateLimiter(size_t size = RATE_LIMIT_TABLE_SIZE);
+    ~PsychicRateLimiter();
+
+    // tokens per period_ms, with up to burst saved up (0 = same as tokens)
+    PsychicRateLimiter* setRate(uint32_t tokens, uint32_t period_ms = 1000, uint32_t burst = 0);
+
+    // takes cost tokens from key's bucket, or returns false and how many seconds until it could
+    bool consume(uint32_t key, uint32_t cost = 1, uint32_t* retry_after = NULL);
+
+    // forget every bucket
+    void reset();
+
+    size_t size() { return _size; }
+    uint32_t allowed() { return _allowed; }
+    uint32_t limited() { return _limited; }
+    uint32_t evicted() { return _evicted; }
+
+    // helpers to build keys
+    static uint32_t hash(const void* data, size_t len, uint32_t seed = 2166136261UL);
+    static uint32_t hash(const char* str, uint32_t seed = 2166136261UL);
+    static uint32_t hash(const PsychicSocketAddress& address);
+};
+
+#endif // PsychicRateLimiter_h
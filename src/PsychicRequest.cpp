@@ -1,8 +1,14 @@
 #include "PsychicRequest.h"
 #include "MultipartProcessor.h"
+#include "PsychicDeferredRequest.h"
 #include "PsychicHttpServer.h"
 #include "http_status.h"
 
+// defer() needs httpd_req_async_handler_begin(), older esp-idf only has our backport of it
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+  #include "async_worker.h"
+#endif
+
 PsychicRequest::PsychicRequest(PsychicHttpServer* server, httpd_req_t* req) : _server(server),
                                                                               _req(req),
                                                                               _endpoint(nullptr),
@@ -188,8 +194,9 @@ esp_err_t PsychicRequest::loadBody()
     actuallyReceived += received;
   }
 
+  // concat with a length so binary bodies (eg. MessagePack) survive embedded NULs
   buf[actuallyReceived] = '\0';
-  this->_body = String(buf);
+  this->_body.concat(buf, actuallyReceived);
   free(buf);
 
   _bodyParsed = ESP_OK;
@@ -197,6 +204,27 @@ esp_err_t PsychicRequest::loadBody()
   return _bodyParsed;
 }
 
+PsychicDeferredRequest* PsychicRequest::defer(uint32_t timeout_ms)
+{
+  // must create a copy of the request that we own
+  httpd_req_t* copy = NULL;
+  esp_err_t err = httpd_req_async_handler_begin(_req, &copy);
+  if (err != ESP_OK) {
+    ESP_LOGE(PH_TAG, "Unable to defer request (%s)", esp_err_to_name(err));
+    return nullptr;
+  }
+
+  PsychicDeferredRequest* deferred = new PsychicDeferredRequest(_server, copy);
+
+  if (timeout_ms) {
+    err = deferred->_startTimer(timeout_ms);
+    if (err != ESP_OK)
+      ESP_LOGE(PH_TAG, "Unable to start deferred request timer (%s)", esp_err_to_name(err));
+  }
+
+  return deferred;
+}
+
 http_method PsychicRequest::method()
 {
   return (http_method)this->_req->method;
@@ -333,17 +361,17 @@ std::list<HTTPHeader>& PsychicRequest::getResponseHeaders()
   return _response->headers();
 }
 
-void PsychicRequest::loadParams()
+void PsychicRequest::loadParams(bool body)
 {
   if (_paramsParsed != ESP_ERR_NOT_FINISHED)
     return;
 
   // convenience shortcut to allow calling loadParams()
-  if (_bodyParsed == ESP_ERR_NOT_FINISHED)
+  if (body && _bodyParsed == ESP_ERR_NOT_FINISHED)
     loadBody();
 
   // various form data as parameters
-  if (this->method() == HTTP_POST) {
+  if (body && this->method() == HTTP_POST) {
     if (this->contentType().startsWith("application/x-www-form-urlencoded"))
       _addParams(_body, true);
 
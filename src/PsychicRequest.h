@@ -11,6 +11,8 @@
   #include <regex>
 #endif
 
+class PsychicDeferredRequest;
+
 typedef std::map<String, String> SessionData;
 
 enum Disposition {
@@ -30,6 +32,7 @@ class PsychicRequest
 {
     friend PsychicHttpServer;
     friend PsychicResponse;
+    friend class PsychicCoroutineHandler;
 
   protected:
     PsychicHttpServer* _server;
@@ -77,6 +80,9 @@ class PsychicRequest
     bool isMultipart();
     esp_err_t loadBody();
 
+    // park this request so it can be answered later from any task, see PsychicDeferredRequest
+    PsychicDeferredRequest* defer(uint32_t timeout_ms = 0);
+
     const String header(const char* name);
     bool hasHeader(const char* name);
 
@@ -127,7 +133,7 @@ class PsychicRequest
     const String& queryString() { return query(); } // compatability function.  same as query()
     const String& url() { return uri(); }           // compatability function.  same as uri()
 
-    void loadParams();
+    void loadParams(bool body = true); // false leaves a streamed body on the socket, only the query is used
     PsychicWebParameter* addParam(PsychicWebParameter* param);
     PsychicWebParameter* addParam(const String& name, const String& value, bool decode = true, bool post = false);
     bool hasParam(const char* key);
@@ -0,0 +1,60 @@
+#include "PsychicRequestStream.h"
+#include "PsychicRequest.h"
+
+PsychicRequestStream::PsychicRequestStream(PsychicRequest* request, size_t limit) : _req(request->request()),
+                                                                                    _pos(0),
+                                                                                    _len(0),
+                                                                                    _remaining(request->contentLength())
+{
+  if (limit && _remaining > limit)
+    _remaining = limit;
+
+  // read() already waits on the socket, don't let Stream spin on top of that
+  setTimeout(0);
+}
+
+bool PsychicRequestStream::_fill()
+{
+  if (_pos < _len)
+    return true;
+
+  while (_remaining > 0) {
+    int received = httpd_req_recv(_req, (char*)_buffer, std::min(_remaining, sizeof(_buffer)));
+
+    if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+      continue;
+    } else if (received <= 0) {
+      ESP_LOGE(PH_TAG, "Failed to receive data.");
+      _remaining = 0;
+      break;
+    }
+
+    _remaining -= received;
+    _pos = 0;
+    _len = received;
+    return true;
+  }
+
+  return false;
+}
+
+int PsychicRequestStream::available()
+{
+  return (_len - _pos) + _remaining;
+}
+
+int PsychicRequestStream::read()
+{
+  if (!_fill())
+    return -1;
+
+  return _buffer[_pos++];
+}
+
+int PsychicRequestStream::peek()
+{
+  if (!_fill())
+    return -1;
+
+  return _buffer[_pos];
+}
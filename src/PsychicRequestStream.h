@@ -0,0 +1,42 @@
+#ifndef PsychicRequestStream_h
+#define PsychicRequestStream_h
+
+#include "PsychicCore.h"
+#include <Stream.h>
+
+#ifndef REQUEST_STREAM_BUFFER_SIZE
+  #define REQUEST_STREAM_BUFFER_SIZE 256
+#endif
+
+/*
+ * PsychicRequestStream :: reads the request body straight off the socket through a small buffer
+ *
+ * Lets parsers like deserializeJson() consume the body without it ever being loaded into RAM.
+ * Don't mix it with request->loadBody(), whatever is read here is gone from the socket.
+ */
+
+class PsychicRequestStream : public Stream
+{
+  protected:
+    httpd_req_t* _req;
+    uint8_t _buffer[REQUEST_STREAM_BUFFER_SIZE];
+    size_t _pos;
+    size_t _len;
+    size_t _remaining;
+
+    bool _fill();
+
+  public:
+    // never reads more than limit bytes of the body (0 = all of it)
+    PsychicRequestStream(PsychicRequest* request, size_t limit = 0);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    // read only
+    size_t write(uint8_t c) override { return 0; }
+    using Print::write;
+};
+
+#endif // PsychicRequestStream_h
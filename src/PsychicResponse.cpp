@@ -7,7 +7,9 @@ PsychicResponse::PsychicResponse(PsychicRequest* request) : _request(request),
                                                             _status(""),
                                                             _contentType(emptyString),
                                                             _contentLength(0),
-                                                            _body("")
+                                                            _body(""),
+                                                            _capture(NULL),
+                                                            _autoETag(false)
 {
   // get our global headers out of the way
   for (auto& header : DefaultHeaders::Instance().getHeaders())
@@ -99,12 +101,18 @@ esp_err_t PsychicResponse::send()
   // our headers too
   this->sendHeaders();
 
+  esp_err_t err;
+  if (checkETag(getContent(), getContentLength(), &err))
+    return err;
+
   // now send it off
-  esp_err_t err = httpd_resp_send(_request->request(), getContent(), getContentLength());
+  err = httpd_resp_send(_request->request(), getContent(), getContentLength());
 
   // did something happen?
   if (err != ESP_OK)
     ESP_LOGE(PH_TAG, "Send response failed (%s)", esp_err_to_name(err));
+  else
+    capture(getContent(), getContentLength(), true);
 
   return err;
 }
@@ -133,7 +141,8 @@ esp_err_t PsychicResponse::sendChunk(uint8_t* chunk, size_t chunksize)
 
     /* Abort sending file */
     httpd_resp_sendstr_chunk(this->_request->request(), NULL);
-  }
+  } else
+    capture((const char*)chunk, chunksize, false);
 
   return err;
 }
@@ -141,7 +150,138 @@ esp_err_t PsychicResponse::sendChunk(uint8_t* chunk, size_t chunksize)
 esp_err_t PsychicResponse::finishChunking()
 {
   /* Respond with an empty chunk to signal HTTP response completion */
-  return httpd_resp_send_chunk(this->_request->request(), NULL, 0);
+  esp_err_t err = httpd_resp_send_chunk(this->_request->request(), NULL, 0);
+  if (err == ESP_OK)
+    capture(NULL, 0, true);
+  return err;
+}
+
+bool PsychicResponse::checkETag(const char* data, size_t len, esp_err_t* err)
+{
+  if (!_autoETag || _code != 200)
+    return false;
+
+  // the handler's own etag wins, eg. a version stamp
+  const char* etag = NULL;
+  for (auto& header : _headers) {
+    if (header.field.equalsIgnoreCase("ETag")) {
+      etag = header.value.c_str();
+      break;
+    }
+  }
+
+  if (etag == NULL) {
+    _headers.push_back({"ETag", makeETag(data, len)});
+    etag = _headers.back().value.c_str();
+    // esp-idf keeps the pointer, the list node stays put until we are gone
+    if (httpd_resp_set_hdr(request(), "ETag", etag) != ESP_OK) {
+      // out of header slots (max_resp_headers), send it without
+      ESP_LOGW(PH_TAG, "No room for the ETag header");
+      _headers.pop_back();
+      return false;
+    }
+  }
+
+  if (!matchesETag(_request->header("If-None-Match"), etag))
+    return false;
+
+  *err = sendNotModified();
+  return true;
+}
+
+esp_err_t PsychicResponse::sendNotModified()
+{
+  // same headers, no body. httpd_resp_send() would add Content-Length: 0, so write it ourselves
+  setCode(304);
+  String out = String();
+  out.concat("HTTP/1.1 304 Not Modified\r\n");
+  for (auto& header : _headers) {
+    if (header.field.equalsIgnoreCase("Content-Length") || header.field.equalsIgnoreCase("Transfer-Encoding"))
+      continue;
+    out.concat(header.field + ": " + header.value + "\r\n");
+  }
+  out.concat("\r\n");
+
+  // httpd_send() may take only part of it
+  const char* data = out.c_str();
+  size_t left = out.length();
+  while (left > 0) {
+    int result = httpd_send(request(), data, left);
+    if (result == HTTPD_SOCK_ERR_TIMEOUT)
+      continue;
+    if (result <= 0) {
+      ESP_LOGE(PH_TAG, "304 send failed (%d)", result);
+      return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    data += result;
+    left -= result;
+  }
+
+  return ESP_OK;
+}
+
+// FNV-1a over the body, plus its length
+String PsychicResponse::makeETag(const char* data, size_t len)
+{
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)data[i];
+    hash *= 16777619UL;
+  }
+
+  char etag[32];
+  snprintf(etag, sizeof(etag), "W/\"%x-%08" PRIx32 "\"", (unsigned int)len, hash);
+  return String(etag);
+}
+
+String PsychicResponse::makeETag(const String& version)
+{
+  return "W/\"v" + version + "\"";
+}
+
+bool PsychicResponse::matchesETag(const String& ifNoneMatch, const String& etag)
+{
+  if (ifNoneMatch.length() == 0)
+    return false;
+
+  // weak comparison, the W/ doesn't count
+  String ours = etag.startsWith("W/") ? etag.substring(2) : etag;
+
+  int start = 0;
+  while (start < (int)ifNoneMatch.length()) {
+    int end = ifNoneMatch.indexOf(',', start);
+    if (end < 0)
+      end = ifNoneMatch.length();
+
+    String theirs = ifNoneMatch.substring(start, end);
+    theirs.trim();
+    if (theirs.startsWith("W/"))
+      theirs = theirs.substring(2);
+
+    if (theirs == "*" || theirs == ours)
+      return true;
+
+    start = end + 1;
+  }
+
+  return false;
+}
+
+void PsychicResponse::capture(const char* data, size_t len, bool done)
+{
+  if (_capture == NULL || _capture->overflow)
+    return;
+
+  if (_capture->body.size() + len > _capture->limit) {
+    _capture->overflow = true;
+    _capture->body.clear();
+    _capture->body.shrink_to_fit();
+    return;
+  }
+
+  if (len)
+    _capture->body.insert(_capture->body.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+  _capture->complete = done;
 }
 
 esp_err_t PsychicResponse::redirect(const char* url)
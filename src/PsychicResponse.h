@@ -3,9 +3,20 @@
 
 #include "PsychicCore.h"
 #include "time.h"
+#include <vector>
 
 class PsychicRequest;
 
+// a copy of the body a response puts on the wire, see PsychicResponse::setCapture()
+struct PsychicResponseCapture {
+    std::vector<uint8_t> body;
+    size_t limit;  // stop copying past this many bytes
+    bool complete; // the whole body went out
+    bool overflow; // it was bigger than limit
+
+    PsychicResponseCapture(size_t limit) : limit(limit), complete(false), overflow(false) {}
+};
+
 class PsychicResponse
 {
   protected:
@@ -17,6 +28,8 @@ class PsychicResponse
     String _contentType;
     int64_t _contentLength;
     const char* _body;
+    PsychicResponseCapture* _capture;
+    bool _autoETag;
 
   public:
     PsychicResponse(PsychicRequest* request);
@@ -57,7 +70,24 @@ class PsychicResponse
     esp_err_t send(int code, const char* contentType, const uint8_t* content, size_t len);
     esp_err_t error(httpd_err_code_t code, const char* message);
 
+    // copy the body into capture as it is sent, single shot or chunked (eg. for a cache)
+    void setCapture(PsychicResponseCapture* capture) { _capture = capture; }
+    // called by whatever sends the body, done marks the end of it
+    void capture(const char* data, size_t len, bool done);
+
+    // tag bodies sent in one piece with a hash of them, and answer 304 when the client has it already
+    void setAutoETag(bool enable) { _autoETag = enable; }
+    // called by whatever sends a single piece body, once the headers are set: true if a 304 went out instead
+    bool checkETag(const char* data, size_t len, esp_err_t* err);
+    // 304 with our headers and no body framing, no Content-Length or Transfer-Encoding
+    esp_err_t sendNotModified();
+    // W/"..." for a body or a version stamp, and If-None-Match matching
+    static String makeETag(const char* data, size_t len);
+    static String makeETag(const String& version);
+    static bool matchesETag(const String& ifNoneMatch, const String& etag);
+
     httpd_req_t* request();
+    PsychicRequest* getRequest() { return _request; }
 };
 
 class PsychicResponseDelegate
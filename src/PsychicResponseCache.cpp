@@ -0,0 +1,254 @@
+#include "PsychicResponseCache.h"
+#include "PsychicRateLimiter.h"
+#include "PsychicRequest.h"
+#include "PsychicResponse.h"
+
+PsychicResponseCache::PsychicResponseCache(size_t budget) : _budget(budget),
+                                                            _used(0),
+                                                            _hits(0),
+                                                            _misses(0),
+                                                            _evictions(0)
+{
+  _lock = xSemaphoreCreateMutex();
+}
+
+PsychicResponseCache::~PsychicResponseCache()
+{
+  _entries.clear();
+  vSemaphoreDelete(_lock);
+}
+
+void PsychicResponseCache::_remove(std::list<entry_ptr>::iterator it)
+{
+  _used -= (*it)->bytes;
+  _entries.erase(it);
+}
+
+bool PsychicResponseCache::varyMatches(const entry_t& entry, PsychicRequest* request)
+{
+  for (auto& header : entry.vary) {
+    if (!request->header(header.field.c_str()).equals(header.value))
+      return false;
+  }
+  return true;
+}
+
+PsychicResponseCache::entry_ptr PsychicResponseCache::find(const String& key, PsychicRequest* request)
+{
+  uint32_t hash = PsychicRateLimiter::hash(key.c_str());
+  unsigned long now = millis();
+  entry_ptr found;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+
+  for (auto it = _entries.begin(); it != _entries.end();) {
+    const entry_t& entry = **it;
+    if (entry.hash != hash || !entry.key.equals(key)) {
+      it++;
+      continue;
+    }
+
+    // expired, nobody gets it anymore
+    if (now - entry.storedAt >= entry.ttl) {
+      auto stale = it++;
+      _remove(stale);
+      continue;
+    }
+
+    if (!varyMatches(entry, request)) {
+      it++;
+      continue;
+    }
+
+    found = *it;
+    _entries.splice(_entries.begin(), _entries, it);
+    break;
+  }
+
+  if (found)
+    _hits++;
+  else
+    _misses++;
+
+  xSemaphoreGive(_lock);
+
+  return found;
+}
+
+std::shared_ptr<PsychicResponseCache::entry_t> PsychicResponseCache::capture(const String& key, PsychicRequest* request, PsychicResponse* response, std::vector<uint8_t>& body)
+{
+  std::shared_ptr<entry_t> entry = std::make_shared<entry_t>();
+  entry->hash = PsychicRateLimiter::hash(key.c_str());
+  entry->key = key;
+  entry->code = response->getCode();
+  entry->contentType = response->getContentType();
+  entry->storedAt = millis();
+  entry->ttl = 0;
+
+  size_t bytes = sizeof(entry_t) + key.length() + entry->contentType.length() + body.size();
+
+  for (auto& header : response->headers()) {
+    // every request header it names becomes part of the key
+    if (header.field.equalsIgnoreCase("Vary")) {
+      if (header.value.indexOf('*') >= 0)
+        return nullptr;
+
+      int start = 0;
+      while (start < (int)header.value.length()) {
+        int end = header.value.indexOf(',', start);
+        if (end < 0)
+          end = header.value.length();
+        String name = header.value.substring(start, end);
+        name.trim();
+        if (name.length()) {
+          entry->vary.push_back({name, request->header(name.c_str())});
+          bytes += name.length() + entry->vary.back().value.length();
+        }
+        start = end + 1;
+      }
+    }
+
+    entry->headers.push_back(header);
+    bytes += header.field.length() + header.value.length();
+  }
+
+  entry->bytes = bytes;
+  entry->body.swap(body);
+
+  return entry;
+}
+
+bool PsychicResponseCache::isShareable(PsychicRequest* request, PsychicResponse* response)
+{
+  bool public_ = false;
+  for (auto& header : response->headers()) {
+    if (header.field.equalsIgnoreCase("Set-Cookie"))
+      return false;
+    if (header.field.equalsIgnoreCase("Cache-Control")) {
+      if (header.value.indexOf("no-store") >= 0 || header.value.indexOf("private") >= 0)
+        return false;
+      if (header.value.indexOf("public") >= 0)
+        public_ = true;
+    }
+  }
+
+  // an authenticated response is for that client only, unless it says otherwise
+  if (request->hasHeader("Authorization") && !public_)
+    return false;
+
+  return true;
+}
+
+String PsychicResponseCache::key(PsychicRequest* request, const std::vector<String>& params, const std::vector<String>& vary)
+{
+  String key = request->path();
+
+  if (params.empty()) {
+    key += "?";
+    key += request->query();
+  } else {
+    for (auto& name : params) {
+      key += "&";
+      key += name;
+      if (request->hasParam(name.c_str())) {
+        key += "=";
+        key += request->getParam(name.c_str())->value();
+      }
+    }
+  }
+
+  for (auto& name : vary) {
+    key += "\n";
+    key += name;
+    key += ":";
+    key += request->header(name.c_str());
+  }
+
+  return key;
+}
+
+bool PsychicResponseCache::store(const String& key, PsychicRequest* request, PsychicResponse* response, std::vector<uint8_t>& body, uint32_t ttl_ms, const std::vector<String>& tags)
+{
+  std::shared_ptr<entry_t> entry = capture(key, request, response, body);
+  if (!entry)
+    return false;
+
+  entry->ttl = ttl_ms;
+  entry->tags = tags;
+  for (auto& tag : tags)
+    entry->bytes += tag.length();
+
+  size_t bytes = entry->bytes;
+  if (bytes > _budget)
+    return false;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+
+  // replace what we had for the same request
+  for (auto it = _entries.begin(); it != _entries.end();) {
+    if ((*it)->hash == entry->hash && (*it)->key.equals(key) && varyMatches(**it, request)) {
+      auto old = it++;
+      _remove(old);
+    } else
+      it++;
+  }
+
+  // least recently served goes first
+  while (_used + bytes > _budget && !_entries.empty()) {
+    _remove(std::prev(_entries.end()));
+    _evictions++;
+  }
+
+  _entries.push_front(entry);
+  _used += bytes;
+
+  xSemaphoreGive(_lock);
+
+  return true;
+}
+
+esp_err_t PsychicResponseCache::send(const entry_t& entry, PsychicResponse* response)
+{
+  char age[12];
+  snprintf(age, sizeof(age), "%lu", (millis() - entry.storedAt) / 1000);
+
+  response->setCode(entry.code);
+  response->setContentType(entry.contentType.c_str());
+  for (auto& header : entry.headers)
+    response->addHeader(header.field.c_str(), header.value.c_str());
+  response->addHeader("Age", age);
+  response->setContent(entry.body.data(), entry.body.size());
+
+  return response->send();
+}
+
+void PsychicResponseCache::invalidate(const char* tag)
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+
+  for (auto it = _entries.begin(); it != _entries.end();) {
+    bool tagged = false;
+    for (auto& t : (*it)->tags) {
+      if (t.equals(tag)) {
+        tagged = true;
+        break;
+      }
+    }
+
+    if (tagged) {
+      auto old = it++;
+      _remove(old);
+    } else
+      it++;
+  }
+
+  xSemaphoreGive(_lock);
+}
+
+void PsychicResponseCache::invalidateAll()
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _entries.clear();
+  _used = 0;
+  xSemaphoreGive(_lock);
+}
@@ -0,0 +1,102 @@
+#ifndef PsychicResponseCache_h
+#define PsychicResponseCache_h
+
+#include "PsychicCore.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <memory>
+#include <vector>
+
+// total bytes of responses a cache keeps by default
+#ifndef RESPONSE_CACHE_BUDGET
+  #define RESPONSE_CACHE_BUDGET (16 * 1024)
+#endif
+
+// bodies bigger than this are sent but not cached
+#ifndef RESPONSE_CACHE_MAX_ENTRY
+  #define RESPONSE_CACHE_MAX_ENTRY (4 * 1024)
+#endif
+
+class PsychicRequest;
+class PsychicResponse;
+
+/*
+ * PsychicResponseCache :: captured responses (status, headers and body) kept within a byte budget
+ *
+ * Entries expire after their ttl and can be dropped early by tag. When the budget is full the
+ * least recently served entries go first. If the response had a Vary header, the request headers
+ * it names are stored with the entry and have to match for a hit.
+ * Fill it with a ResponseCacheMiddleware, several of them (one per route) can share one cache.
+ */
+
+class PsychicResponseCache
+{
+  public:
+    typedef struct {
+        uint32_t hash;
+        String key;
+        std::vector<HTTPHeader> vary; // request headers named by the response's Vary, and their values
+        std::vector<String> tags;
+
+        int code;
+        String contentType;
+        std::vector<HTTPHeader> headers;
+        std::vector<uint8_t> body;
+
+        unsigned long storedAt;
+        uint32_t ttl;
+        size_t bytes;
+    } entry_t;
+
+    typedef std::shared_ptr<const entry_t> entry_ptr;
+
+  protected:
+    std::list<entry_ptr> _entries; // most recently served first
+    size_t _budget;
+    size_t _used;
+    SemaphoreHandle_t _lock;
+
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _evictions;
+
+    void _remove(std::list<entry_ptr>::iterator it);
+
+  public:
+    PsychicResponseCache(size_t budget = RESPONSE_CACHE_BUDGET);
+    ~PsychicResponseCache();
+
+    // a fresh entry for key that matches request, or nullptr
+    entry_ptr find(const String& key, PsychicRequest* request);
+
+    // keep what response sent for ttl_ms, body is moved out of the capture
+    bool store(const String& key, PsychicRequest* request, PsychicResponse* response, std::vector<uint8_t>& body, uint32_t ttl_ms, const std::vector<String>& tags);
+
+    // true if request has the same values for the headers entry was stored with
+    static bool varyMatches(const entry_t& entry, PsychicRequest* request);
+
+    // replay an entry on response, with an Age header
+    static esp_err_t send(const entry_t& entry, PsychicResponse* response);
+
+    // an entry for what response sent, body is moved out of the capture. nullptr if it can't be reused (Vary: *)
+    static std::shared_ptr<entry_t> capture(const String& key, PsychicRequest* request, PsychicResponse* response, std::vector<uint8_t>& body);
+
+    // false if response is meant for this client only (Set-Cookie, Cache-Control: private / no-store),
+    // or answers a request with Authorization and doesn't say Cache-Control: public
+    static bool isShareable(PsychicRequest* request, PsychicResponse* response);
+
+    // path plus either the whole query or just params, and the values of the vary request headers
+    static String key(PsychicRequest* request, const std::vector<String>& params, const std::vector<String>& vary);
+
+    void invalidate(const char* tag);
+    void invalidateAll();
+
+    size_t budget() { return _budget; }
+    size_t used() { return _used; }
+    size_t count() { return _entries.size(); }
+    uint32_t hits() { return _hits; }
+    uint32_t misses() { return _misses; }
+    uint32_t evictions() { return _evictions; }
+};
+
+#endif // PsychicResponseCache_h
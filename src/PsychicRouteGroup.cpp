@@ -0,0 +1,139 @@
+#include "PsychicRouteGroup.h"
+#include "PsychicEndpoint.h"
+#include "PsychicHandler.h"
+#include "PsychicHttpServer.h"
+#include "PsychicMiddleware.h"
+#include "PsychicMiddlewareChain.h"
+#include <vector>
+
+PsychicRouteGroup::PsychicRouteGroup(PsychicHttpServer* server, PsychicRouteGroup* parent, const char* prefix) : _server(server),
+                                                                                                                  _parent(parent),
+                                                                                                                  _prefix(prefix)
+{
+  // "/api/" + "/status" should still be /api/status
+  while (_prefix.endsWith("/"))
+    _prefix.remove(_prefix.length() - 1);
+
+  if (_parent != NULL)
+    _prefix = _parent->_prefix + _prefix;
+}
+
+PsychicRouteGroup::~PsychicRouteGroup()
+{
+  for (auto* group : _groups)
+    delete group;
+  _groups.clear();
+
+  for (auto* middleware : _owned)
+    delete middleware;
+  _owned.clear();
+}
+
+PsychicRouteGroup* PsychicRouteGroup::group(const char* prefix)
+{
+  PsychicRouteGroup* group = new PsychicRouteGroup(_server, this, prefix);
+  _groups.push_back(group);
+  return group;
+}
+
+PsychicRouteGroup* PsychicRouteGroup::addFilter(PsychicRequestFilterFunction fn)
+{
+  _filters.push_back(fn);
+  return this;
+}
+
+PsychicRouteGroup* PsychicRouteGroup::addMiddleware(PsychicMiddleware* middleware)
+{
+  _middleware.push_back(middleware);
+  return this;
+}
+
+PsychicRouteGroup* PsychicRouteGroup::addMiddleware(PsychicMiddlewareCallback fn)
+{
+  PsychicMiddlewareFunction* closure = new PsychicMiddlewareFunction(fn);
+  _owned.push_back(closure);
+  return addMiddleware(closure);
+}
+
+String PsychicRouteGroup::_uri(const char* uri)
+{
+  return _prefix + uri;
+}
+
+void PsychicRouteGroup::_apply(PsychicHandler* handler)
+{
+  // outermost group first, all in front of whatever the handler came with
+  std::list<PsychicRequestFilterFunction> filters;
+  std::vector<PsychicMiddleware*> middleware;
+  for (PsychicRouteGroup* group = this; group != NULL; group = group->_parent) {
+    filters.insert(filters.begin(), group->_filters.begin(), group->_filters.end());
+    middleware.insert(middleware.begin(), group->_middleware.begin(), group->_middleware.end());
+  }
+
+  handler->_filters.splice(handler->_filters.begin(), filters);
+
+  if (middleware.empty())
+    return;
+  if (!handler->_chain)
+    handler->_chain = new PsychicMiddlewareChain();
+  for (size_t i = 0; i < middleware.size(); i++)
+    handler->_chain->insertMiddleware(i, middleware[i]);
+}
+
+PsychicEndpoint* PsychicRouteGroup::_attach(PsychicEndpoint* endpoint)
+{
+  _apply(endpoint->handler());
+  return endpoint;
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri)
+{
+  return _attach(_server->on(_uri(uri).c_str()));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, int method)
+{
+  return _attach(_server->on(_uri(uri).c_str(), method));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, PsychicHandler* handler)
+{
+  return _attach(_server->on(_uri(uri).c_str(), handler));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, int method, PsychicHandler* handler)
+{
+  return _attach(_server->on(_uri(uri).c_str(), method, handler));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, PsychicHttpRequestCallback onRequest)
+{
+  return _attach(_server->on(_uri(uri).c_str(), onRequest));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, int method, PsychicHttpRequestCallback onRequest)
+{
+  return _attach(_server->on(_uri(uri).c_str(), method, onRequest));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, PsychicJsonRequestCallback onRequest)
+{
+  return _attach(_server->on(_uri(uri).c_str(), onRequest));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, int method, PsychicJsonRequestCallback onRequest)
+{
+  return _attach(_server->on(_uri(uri).c_str(), method, onRequest));
+}
+
+#ifdef ENABLE_COROUTINES
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, PsychicCoroutineCallback onRequest)
+{
+  return _attach(_server->on(_uri(uri).c_str(), onRequest));
+}
+
+PsychicEndpoint* PsychicRouteGroup::on(const char* uri, int method, PsychicCoroutineCallback onRequest)
+{
+  return _attach(_server->on(_uri(uri).c_str(), method, onRequest));
+}
+#endif
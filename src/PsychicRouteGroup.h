@@ -0,0 +1,72 @@
+#ifndef PsychicRouteGroup_h
+#define PsychicRouteGroup_h
+
+#include "PsychicCore.h"
+
+class PsychicEndpoint;
+class PsychicHandler;
+class PsychicHttpServer;
+class PsychicMiddleware;
+
+/*
+ * PsychicRouteGroup :: endpoints under a common prefix that share middleware and filters, eg.
+ *
+ *   PsychicRouteGroup* api = server.group("/api");
+ *   api->addMiddleware(&auth)->addMiddleware(&cors);
+ *   api->on("/status", HTTP_GET, status_handler); // -> /api/status
+ *
+ * The group's filters and middleware are copied onto each endpoint when it is registered, in front of
+ * the endpoint's own, so requests outside the group never run them. Set the group up before adding
+ * its endpoints, anything added to it later only applies to endpoints added after that.
+ * Groups belong to the server and live until it is reset or destroyed.
+ */
+
+class PsychicRouteGroup
+{
+    friend PsychicHttpServer;
+
+  protected:
+    PsychicHttpServer* _server;
+    PsychicRouteGroup* _parent;
+    String _prefix;
+
+    std::list<PsychicRequestFilterFunction> _filters;
+    std::list<PsychicMiddleware*> _middleware;
+    std::list<PsychicMiddleware*> _owned; // wrappers for callback middleware
+    std::list<PsychicRouteGroup*> _groups;
+
+    PsychicRouteGroup(PsychicHttpServer* server, PsychicRouteGroup* parent, const char* prefix);
+
+    // resolves the filters and middleware of this group and its parents onto the endpoint
+    PsychicEndpoint* _attach(PsychicEndpoint* endpoint);
+    void _apply(PsychicHandler* handler);
+    String _uri(const char* uri);
+
+  public:
+    ~PsychicRouteGroup();
+
+    const String& prefix() { return _prefix; }
+
+    // a nested group, it runs our middleware before its own
+    PsychicRouteGroup* group(const char* prefix);
+
+    PsychicRouteGroup* addFilter(PsychicRequestFilterFunction fn);
+    PsychicRouteGroup* addMiddleware(PsychicMiddleware* middleware);
+    PsychicRouteGroup* addMiddleware(PsychicMiddlewareCallback fn);
+
+    // same as the server's on(), with uri relative to the prefix
+    PsychicEndpoint* on(const char* uri);
+    PsychicEndpoint* on(const char* uri, int method);
+    PsychicEndpoint* on(const char* uri, PsychicHandler* handler);
+    PsychicEndpoint* on(const char* uri, int method, PsychicHandler* handler);
+    PsychicEndpoint* on(const char* uri, PsychicHttpRequestCallback onRequest);
+    PsychicEndpoint* on(const char* uri, int method, PsychicHttpRequestCallback onRequest);
+    PsychicEndpoint* on(const char* uri, PsychicJsonRequestCallback onRequest);
+    PsychicEndpoint* on(const char* uri, int method, PsychicJsonRequestCallback onRequest);
+#ifdef ENABLE_COROUTINES
+    PsychicEndpoint* on(const char* uri, PsychicCoroutineCallback onRequest);
+    PsychicEndpoint* on(const char* uri, int method, PsychicCoroutineCallback onRequest);
+#endif
+};
+
+#endif // PsychicRouteGroup_h
@@ -5,7 +5,7 @@
 /*************************************/
 
 PsychicStaticFileHandler::PsychicStaticFileHandler(const char* uri, FS& fs, const char* path, const char* cache_control)
-    : _fs(fs), _uri(uri), _path(path), _default_file("index.html"), _cache_control(cache_control), _last_modified("")
+    : _fs(fs), _uri(uri), _path(path), _default_file("index.html"), _cache_control(cache_control), _last_modified(""), _pipelined(false)
 {
   // Ensure leading '/'
   if (_uri.length() == 0 || _uri[0] != '/')
@@ -60,6 +60,12 @@ PsychicStaticFileHandler* PsychicStaticFileHandler::setLastModified(struct tm* l
   return setLastModified((const char*)result);
 }
 
+PsychicStaticFileHandler* PsychicStaticFileHandler::setPipelined(bool pipelined)
+{
+  _pipelined = pipelined;
+  return this;
+}
+
 bool PsychicStaticFileHandler::canHandle(PsychicRequest* request)
 {
   if (request->method() != HTTP_GET) {
@@ -181,6 +187,7 @@ esp_err_t PsychicStaticFileHandler::handleRequest(PsychicRequest* request, Psych
     // nope, send them the full file.
     else {
       PsychicFileResponse response(res, _fs, _filename);
+      response.setPipelined(_pipelined);
 
       if (_last_modified.length())
         response.addHeader("Last-Modified", _last_modified.c_str());
@@ -29,6 +29,7 @@ class PsychicStaticFileHandler : public PsychicWebHandler
     bool _isDir;
     bool _gzipFirst;
     uint8_t _gzipStats;
+    bool _pipelined;
 
   public:
     PsychicStaticFileHandler(const char* uri, FS& fs, const char* path, const char* cache_control);
@@ -39,6 +40,7 @@ class PsychicStaticFileHandler : public PsychicWebHandler
     PsychicStaticFileHandler* setCacheControl(const char* cache_control);
     PsychicStaticFileHandler* setLastModified(const char* last_modified);
     PsychicStaticFileHandler* setLastModified(struct tm* last_modified);
+    PsychicStaticFileHandler* setPipelined(bool pipelined);
     // PsychicStaticFileHandler* setTemplateProcessor(AwsTemplateProcessor newCallback) {_callback = newCallback; return *this;}
 };
 
@@ -3,7 +3,7 @@
 #include "PsychicResponse.h"
 
 PsychicStreamResponse::PsychicStreamResponse(PsychicResponse* response, const String& contentType)
-    : PsychicResponseDelegate(response), _buffer(NULL)
+    : PsychicResponseDelegate(response), _buffer(NULL), _bufferSize(STREAM_CHUNK_SIZE), _flushInterval(0)
 {
 
   setContentType(contentType.c_str());
@@ -11,7 +11,7 @@ PsychicStreamResponse::PsychicStreamResponse(PsychicResponse* response, const St
 }
 
 PsychicStreamResponse::PsychicStreamResponse(PsychicResponse* response, const String& contentType, const String& name)
-    : PsychicResponseDelegate(response), _buffer(NULL)
+    : PsychicResponseDelegate(response), _buffer(NULL), _bufferSize(STREAM_CHUNK_SIZE), _flushInterval(0)
 {
 
   setContentType(contentType.c_str());
@@ -32,17 +32,18 @@ esp_err_t PsychicStreamResponse::beginSend()
     return ESP_OK;
 
   // Buffer to hold ChunkPrinter and stream buffer. Using placement new will keep us at a single allocation.
-  _buffer = (uint8_t*)malloc(STREAM_CHUNK_SIZE + sizeof(ChunkPrinter));
+  _buffer = (uint8_t*)malloc(_bufferSize + sizeof(ChunkPrinter));
 
   if (!_buffer)
   {
     /* Respond with 500 Internal Server Error */
-    ESP_LOGE(PH_TAG, "Unable to allocate %" PRIu32 " bytes to send chunk", STREAM_CHUNK_SIZE + sizeof(ChunkPrinter));
+    ESP_LOGE(PH_TAG, "Unable to allocate %" PRIu32 " bytes to send chunk", _bufferSize + sizeof(ChunkPrinter));
     httpd_resp_send_err(request(), HTTPD_500_INTERNAL_SERVER_ERROR, "Unable to allocate memory.");
     return ESP_FAIL;
   }
 
-  _printer = new (_buffer) ChunkPrinter(_response, _buffer + sizeof(ChunkPrinter), STREAM_CHUNK_SIZE);
+  _printer = new (_buffer) ChunkPrinter(_response, _buffer + sizeof(ChunkPrinter), _bufferSize);
+  _printer->setFlushInterval(_flushInterval);
 
   sendHeaders();
   return ESP_OK;
@@ -70,6 +71,11 @@ void PsychicStreamResponse::flush()
     _printer->flush();
 }
 
+bool PsychicStreamResponse::flushIfDue()
+{
+  return _buffer ? _printer->flushIfDue() : false;
+}
+
 size_t PsychicStreamResponse::write(uint8_t data)
 {
   return _buffer ? _printer->write(data) : 0;
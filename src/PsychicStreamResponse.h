@@ -12,6 +12,8 @@ class PsychicStreamResponse : public PsychicResponseDelegate, public Print
   private:
     ChunkPrinter* _printer;
     uint8_t* _buffer;
+    size_t _bufferSize;
+    uint32_t _flushInterval;
 
   public:
     PsychicStreamResponse(PsychicResponse* response, const String& contentType);
@@ -19,11 +21,18 @@ class PsychicStreamResponse : public PsychicResponseDelegate, public Print
 
     ~PsychicStreamResponse();
 
+    // both must be set before beginSend()
+    void setBufferSize(size_t size) { _bufferSize = size; }
+    void setFlushInterval(uint32_t ms) { _flushInterval = ms; }
+
     esp_err_t beginSend();
     esp_err_t endSend();
 
     void flush() override;
 
+    // sends a partial chunk if the flush interval has passed, for producers that block between writes
+    bool flushIfDue();
+
     size_t write(uint8_t data) override;
     size_t write(const uint8_t* buffer, size_t size) override;
 
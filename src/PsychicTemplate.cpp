@@ -0,0 +1,271 @@
+#include "PsychicTemplate.h"
+#include "PsychicStreamResponse.h"
+
+PsychicTemplate::PsychicTemplate(fs::FS& fs, const char* path, const char delimiter) : _fs(&fs),
+                                                                                      _path(path),
+                                                                                      _text(NULL),
+                                                                                      _textLength(0),
+                                                                                      _delimiter(delimiter),
+                                                                                      _fallback(nullptr),
+                                                                                      _fragments(NULL),
+                                                                                      _compiles(0)
+{
+  _lock = xSemaphoreCreateMutex();
+}
+
+PsychicTemplate::PsychicTemplate(const char* text, const char delimiter) : _fs(NULL),
+                                                                          _text(text),
+                                                                          _textLength(strlen(text)),
+                                                                          _delimiter(delimiter),
+                                                                          _fallback(nullptr),
+                                                                          _fragments(NULL),
+                                                                          _compiles(0)
+{
+  _lock = xSemaphoreCreateMutex();
+}
+
+PsychicTemplate::~PsychicTemplate()
+{
+  vSemaphoreDelete(_lock);
+}
+
+PsychicTemplate* PsychicTemplate::on(const char* name, PsychicTemplateCallback fn)
+{
+  _callbacks[name] = fn;
+  invalidate();
+  return this;
+}
+
+PsychicTemplate* PsychicTemplate::onParam(TemplateCallback fn)
+{
+  _fallback = fn;
+  return this;
+}
+
+PsychicTemplate* PsychicTemplate::setFragmentCache(PsychicFragmentCache* cache)
+{
+  _fragments = cache;
+  invalidate();
+  return this;
+}
+
+void PsychicTemplate::invalidate()
+{
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _compiled.reset();
+  xSemaphoreGive(_lock);
+}
+
+std::shared_ptr<const PsychicTemplate::Compiled> PsychicTemplate::_acquire(File* file)
+{
+  time_t lastWrite = 0;
+  size_t size = _textLength;
+  if (file != NULL) {
+    lastWrite = file->getLastWrite();
+    size = file->size();
+  }
+
+  // only one task re-parses, the others wait for it and share the result
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  std::shared_ptr<const Compiled> compiled = _compiled;
+  if (!compiled || compiled->lastWrite != lastWrite || compiled->size != size) {
+    compiled = _compile(file, lastWrite, size);
+    _compiled = compiled;
+  }
+  xSemaphoreGive(_lock);
+
+  return compiled;
+}
+
+std::shared_ptr<const PsychicTemplate::Compiled> PsychicTemplate::_compile(File* file, time_t lastWrite, size_t size)
+{
+  std::shared_ptr<Compiled> compiled = std::make_shared<Compiled>();
+  compiled->lastWrite = lastWrite;
+  compiled->size = size;
+
+  bool inParam = false;
+  uint32_t paramStart = 0;
+  uint32_t literalStart = 0;
+  char name[64];
+  size_t nameLen = 0;
+
+  uint8_t block[TEMPLATE_READ_SIZE];
+  uint32_t offset = 0;
+
+  while (offset < size) {
+    // files get scanned a block at a time, text in one go
+    const uint8_t* data;
+    size_t len;
+    if (file != NULL) {
+      len = file->read(block, std::min(sizeof(block), size - offset));
+      if (!len)
+        break;
+      data = block;
+    } else {
+      data = (const uint8_t*)_text;
+      len = size;
+    }
+
+    size_t i = 0;
+    while (i < len) {
+      if (!inParam) {
+        const uint8_t* next = (const uint8_t*)memchr(data + i, _delimiter, len - i);
+        if (!next) {
+          i = len;
+          break;
+        }
+
+        i = next - data;
+        inParam = true;
+        paramStart = offset + i;
+        nameLen = 0;
+        i++;
+        continue;
+      }
+
+      uint8_t c = data[i];
+      if (c == _delimiter) {
+        inParam = false;
+
+        // %% is just text
+        if (nameLen) {
+          name[nameLen] = '\0';
+
+          if (paramStart > literalStart)
+            compiled->segments.push_back({literalStart, paramStart - literalStart, -1});
+
+          // resolve the name to an index now, so rendering never compares strings
+          int16_t id = -1;
+          for (size_t p = 0; p < compiled->placeholders.size(); p++) {
+            if (compiled->placeholders[p].name.equals(name)) {
+              id = p;
+              break;
+            }
+          }
+          if (id < 0) {
+            PsychicTemplateCallback fn = nullptr;
+            auto callback = _callbacks.find(name);
+            PsychicFragmentCache::Fragment* fragment;
+            if (callback != _callbacks.end())
+              fn = callback->second;
+            else if (_fragments != NULL && (fragment = _fragments->find(name)) != NULL) {
+              PsychicFragmentCache* cache = _fragments;
+              fn = [cache, fragment](Print& output) { return cache->render(fragment, output); };
+            }
+
+            compiled->placeholders.push_back({String(name), fn});
+            id = compiled->placeholders.size() - 1;
+          }
+
+          compiled->segments.push_back({paramStart, offset + (uint32_t)i + 1 - paramStart, id});
+          literalStart = offset + i + 1;
+        }
+      } else if ((isalnum(c) || c == '_') && nameLen < sizeof(name) - 1)
+        name[nameLen++] = c;
+      else
+        inParam = false;
+
+      i++;
+    }
+
+    offset += len;
+  }
+
+  if (size > literalStart)
+    compiled->segments.push_back({literalStart, (uint32_t)(size - literalStart), -1});
+
+  _compiles++;
+  return compiled;
+}
+
+void PsychicTemplate::_placeholder(Print& output, const Placeholder& placeholder, const uint8_t* raw, size_t len)
+{
+  bool handled;
+  if (placeholder.callback)
+    handled = placeholder.callback(output);
+  else
+    handled = _fallback && _fallback(output, placeholder.name.c_str());
+
+  // not ours after all, print it as is
+  if (!handled)
+    output.write(raw, len);
+}
+
+void PsychicTemplate::_render(Print& output, const Compiled& compiled, File* file)
+{
+  if (file == NULL) {
+    for (const Segment& segment : compiled.segments) {
+      const uint8_t* raw = (const uint8_t*)_text + segment.offset;
+      if (segment.placeholder < 0)
+        output.write(raw, segment.length);
+      else
+        _placeholder(output, compiled.placeholders[segment.placeholder], raw, segment.length);
+    }
+    return;
+  }
+
+  // segments cover the whole file in order, so it is read front to back exactly once
+  uint8_t block[TEMPLATE_READ_SIZE];
+  file->seek(0);
+
+  for (const Segment& segment : compiled.segments) {
+    if (segment.placeholder < 0) {
+      size_t remaining = segment.length;
+      while (remaining) {
+        size_t len = file->read(block, std::min(sizeof(block), remaining));
+        if (!len)
+          return;
+        output.write(block, len);
+        remaining -= len;
+      }
+    } else {
+      // a placeholder is at most 65 bytes, it only gets printed if the callback declines
+      size_t len = file->read(block, segment.length);
+      if (len != segment.length)
+        return;
+      _placeholder(output, compiled.placeholders[segment.placeholder], block, len);
+    }
+  }
+}
+
+bool PsychicTemplate::render(Print& output)
+{
+  if (_fs == NULL) {
+    _render(output, *_acquire(NULL), NULL);
+    return true;
+  }
+
+  File file = _fs->open(_path, "r");
+  if (!file || file.isDirectory()) {
+    ESP_LOGE(PH_TAG, "Unable to open template %s", _path.c_str());
+    return false;
+  }
+
+  _render(output, *_acquire(&file), &file);
+  file.close();
+  return true;
+}
+
+esp_err_t PsychicTemplate::send(PsychicResponse* response, const char* contentType)
+{
+  File file;
+  if (_fs != NULL) {
+    file = _fs->open(_path, "r");
+    if (!file || file.isDirectory())
+      return response->send(404, "text/html", "Not found");
+  }
+
+  File* source = _fs != NULL ? &file : NULL;
+  std::shared_ptr<const Compiled> compiled = _acquire(source);
+
+  PsychicStreamResponse stream(response, contentType);
+  esp_err_t err = stream.beginSend();
+  if (err == ESP_OK) {
+    _render(stream, *compiled, source);
+    err = stream.endSend();
+  }
+
+  if (source != NULL)
+    file.close();
+  return err;
+}
@@ -0,0 +1,89 @@
+#ifndef PsychicTemplate_h
+#define PsychicTemplate_h
+
+#include "PsychicCore.h"
+#include "PsychicFragmentCache.h"
+#include "PsychicResponse.h"
+#include "TemplatePrinter.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <memory>
+#include <vector>
+
+// block size used to scan and to copy literal text out of template files
+#ifndef TEMPLATE_READ_SIZE
+  #define TEMPLATE_READ_SIZE 512
+#endif
+
+/*
+ * PsychicTemplate :: a template parsed once into literal spans and placeholder ids
+ *
+ * Uses the same %PARAM% rules as TemplatePrinter, but the source is only scanned when it changes
+ * (file size or mtime, or invalidate()). Rendering copies literal spans in bulk and calls the
+ * callback registered for each placeholder directly, instead of looking at every byte.
+ */
+
+class PsychicTemplate
+{
+    using File = fs::File;
+
+  protected:
+    struct Segment {
+        uint32_t offset;
+        uint32_t length;
+        int16_t placeholder; // -1 for literal text
+    };
+
+    struct Placeholder {
+        String name;
+        PsychicTemplateCallback callback;
+    };
+
+    // immutable once built, renders keep their own reference while a recompile swaps in a new one
+    struct Compiled {
+        time_t lastWrite;
+        size_t size;
+        std::vector<Segment> segments;
+        std::vector<Placeholder> placeholders;
+    };
+
+    fs::FS* _fs;
+    String _path;
+    const char* _text;
+    size_t _textLength;
+    char _delimiter;
+
+    std::map<String, PsychicTemplateCallback> _callbacks;
+    TemplateCallback _fallback;
+    PsychicFragmentCache* _fragments;
+
+    std::shared_ptr<const Compiled> _compiled;
+    SemaphoreHandle_t _lock;
+    uint32_t _compiles;
+
+    std::shared_ptr<const Compiled> _acquire(File* file);
+    std::shared_ptr<const Compiled> _compile(File* file, time_t lastWrite, size_t size);
+    void _render(Print& output, const Compiled& compiled, File* file);
+    void _placeholder(Print& output, const Placeholder& placeholder, const uint8_t* raw, size_t len);
+
+  public:
+    PsychicTemplate(fs::FS& fs, const char* path, const char delimiter = '%');
+    PsychicTemplate(const char* text, const char delimiter = '%');
+    ~PsychicTemplate();
+
+    // handle %name%, return false to print the placeholder as is
+    PsychicTemplate* on(const char* name, PsychicTemplateCallback fn);
+    // anything without its own callback, same signature as TemplatePrinter
+    PsychicTemplate* onParam(TemplateCallback fn);
+    // placeholders named after a fragment in the cache render from it
+    PsychicTemplate* setFragmentCache(PsychicFragmentCache* cache);
+
+    // force a re-parse on the next render
+    void invalidate();
+    uint32_t compiles() { return _compiles; }
+
+    bool render(Print& output);
+    esp_err_t send(PsychicResponse* response, const char* contentType = "text/html");
+};
+
+#endif // PsychicTemplate_h
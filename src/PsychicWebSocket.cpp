@@ -118,7 +118,9 @@ esp_err_t PsychicWebSocketClient::sendMessage(const char* buf)
 PsychicWebSocketHandler::PsychicWebSocketHandler() : PsychicHandler(),
                                                      _onOpen(NULL),
                                                      _onFrame(NULL),
-                                                     _onClose(NULL)
+                                                     _onClose(NULL),
+                                                     _limiter(NULL),
+                                                     _limitAction(RATE_LIMIT_DROP)
 {
 }
 
@@ -210,6 +212,14 @@ esp_err_t PsychicWebSocketHandler::handleRequest(PsychicRequest* request, Psychi
     return ret;
   }
 
+  // over the limit? only data frames count, control frames are always handled
+  bool limited = false;
+  if (_limiter != NULL && (ws_pkt.type == HTTPD_WS_TYPE_TEXT || ws_pkt.type == HTTPD_WS_TYPE_BINARY)) {
+    limited = !_limiter->consume(PsychicRateLimiter::hash(request->client()->remoteAddress()));
+    if (limited && _limitAction == RATE_LIMIT_CLOSE)
+      return _closeLimited(wsRequest);
+  }
+
   // okay, now try to load the packet
   // ESP_LOGD(PH_TAG, "frame len is %d", ws_pkt.len);
   if (ws_pkt.len) {
@@ -238,7 +248,7 @@ esp_err_t PsychicWebSocketHandler::handleRequest(PsychicRequest* request, Psychi
   }
   // Text messages are our payload.
   if (ws_pkt.type == HTTPD_WS_TYPE_TEXT || ws_pkt.type == HTTPD_WS_TYPE_BINARY) {
-    if (this->_onFrame != NULL)
+    if (this->_onFrame != NULL && !limited)
       ret = this->_onFrame(&wsRequest, &ws_pkt);
   }
 
@@ -256,6 +266,18 @@ esp_err_t PsychicWebSocketHandler::handleRequest(PsychicRequest* request, Psychi
   return ret;
 }
 
+esp_err_t PsychicWebSocketHandler::_closeLimited(PsychicWebSocketRequest& request)
+{
+  // 1008 policy violation, big endian
+  static const uint8_t status[] = {0x03, 0xF0};
+
+  ESP_LOGW(PH_TAG, "Closing websocket %d, over the rate limit", request.client()->socket());
+  request.reply(HTTPD_WS_TYPE_CLOSE, status, sizeof(status));
+  request.client()->close();
+
+  return ESP_OK;
+}
+
 PsychicWebSocketHandler* PsychicWebSocketHandler::onOpen(PsychicWebSocketClientCallback fn)
 {
   _onOpen = fn;
@@ -304,3 +326,10 @@ void PsychicWebSocketHandler::sendAll(const char* buf)
 {
   this->sendAll(HTTPD_WS_TYPE_TEXT, buf, strlen(buf));
 }
+
+PsychicWebSocketHandler* PsychicWebSocketHandler::setRateLimit(PsychicRateLimiter* limiter, PsychicRateLimitAction action)
+{
+  _limiter = limiter;
+  _limitAction = action;
+  return this;
+}
@@ -2,11 +2,18 @@
 #define PsychicWebSocket_h
 
 #include "PsychicCore.h"
+#include "PsychicRateLimiter.h"
 #include "PsychicRequest.h"
 
 class PsychicWebSocketRequest;
 class PsychicWebSocketClient;
 
+// what happens to a text or binary frame once its client is over the rate limit
+enum PsychicRateLimitAction {
+  RATE_LIMIT_DROP, // read it and throw it away, onFrame never sees it
+  RATE_LIMIT_CLOSE // close the connection with 1008 (policy violation)
+};
+
 // callback function definitions
 typedef std::function<void(PsychicWebSocketClient* client)> PsychicWebSocketClientCallback;
 typedef std::function<esp_err_t(PsychicWebSocketRequest* request, httpd_ws_frame* frame)> PsychicWebSocketFrameCallback;
@@ -48,6 +55,11 @@ class PsychicWebSocketHandler : public PsychicHandler
     PsychicWebSocketFrameCallback _onFrame;
     PsychicWebSocketClientCallback _onClose;
 
+    PsychicRateLimiter* _limiter;
+    PsychicRateLimitAction _limitAction;
+
+    esp_err_t _closeLimited(PsychicWebSocketRequest& request);
+
   public:
     PsychicWebSocketHandler();
     ~PsychicWebSocketHandler();
@@ -66,6 +78,9 @@ class PsychicWebSocketHandler : public PsychicHandler
     PsychicWebSocketHandler* onFrame(PsychicWebSocketFrameCallback fn);
     PsychicWebSocketHandler* onClose(PsychicWebSocketClientCallback fn);
 
+    // count incoming text and binary frames per client address, NULL turns it off
+    PsychicWebSocketHandler* setRateLimit(PsychicRateLimiter* limiter, PsychicRateLimitAction action = RATE_LIMIT_DROP);
+
     void sendAll(httpd_ws_frame_t* ws_pkt);
     void sendAll(httpd_ws_type_t op, const void* data, size_t len);
     void sendAll(const char* buf);
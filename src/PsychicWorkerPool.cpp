@@ -0,0 +1,489 @@
+#include "PsychicWorkerPool.h"
+#include "PsychicResponse.h"
+#include "async_worker.h"
+#include <algorithm>
+#include <vector>
+
+PsychicWorkerPool::PsychicWorkerPool() : _count(ASYNC_WORKER_COUNT),
+                                         _reserved(0),
+                                         _stackSize(ASYNC_WORKER_TASK_STACK_SIZE),
+                                         _priority(ASYNC_WORKER_TASK_PRIORITY),
+                                         _core(tskNO_AFFINITY),
+                                         _depth(ASYNC_WORKER_QUEUE_DEPTH),
+                                         _admission(WORKER_REJECT),
+                                         _admissionTimeout(0),
+                                         _shared(NULL),
+                                         _workers(NULL),
+                                         _started(0),
+                                         _running(false),
+                                         _stopping(false),
+                                         _queue(NULL),
+                                         _queued(0),
+                                         _sequence(0),
+                                         _lock(NULL),
+                                         _space(NULL),
+                                         _stopped(NULL),
+                                         _rejected(0),
+                                         _shed(0),
+                                         _active(0),
+                                         _samples(0),
+                                         _nextSample(0),
+                                         _p95(0),
+                                         _intervalStart(0),
+                                         _intervalMin(UINT32_MAX),
+                                         _standing(0),
+                                         _retryAfter(1)
+{
+}
+
+PsychicWorkerPool::~PsychicWorkerPool()
+{
+  end();
+}
+
+PsychicWorkerPool* PsychicWorkerPool::setWorkers(uint8_t count)
+{
+  _count = count;
+  return this;
+}
+
+PsychicWorkerPool* PsychicWorkerPool::setReserved(uint8_t count)
+{
+  _reserved = count;
+  return this;
+}
+
+PsychicWorkerPool* PsychicWorkerPool::setStackSize(uint32_t size)
+{
+  _stackSize = size;
+  return this;
+}
+
+PsychicWorkerPool* PsychicWorkerPool::setPriority(UBaseType_t priority)
+{
+  _priority = priority;
+  return this;
+}
+
+PsychicWorkerPool* PsychicWorkerPool::setCore(BaseType_t core)
+{
+  _core = core;
+  return this;
+}
+
+PsychicWorkerPool* PsychicWorkerPool::setQueueDepth(size_t depth)
+{
+  _depth = depth ? depth : 1;
+  return this;
+}
+
+PsychicWorkerPool* PsychicWorkerPool::setAdmission(PsychicWorkerAdmission policy, uint32_t timeout_ms)
+{
+  _admission = policy;
+  _admissionTimeout = timeout_ms;
+  return this;
+}
+
+esp_err_t PsychicWorkerPool::begin()
+{
+  if (_running)
+    return ESP_OK;
+
+  // at least one worker has to take everything else
+  if (_reserved >= _count)
+    _reserved = _count ? _count - 1 : 0;
+
+  _shared = (shared_t*)calloc(1, sizeof(shared_t));
+  _workers = (worker_t*)calloc(_count, sizeof(worker_t));
+  _queue = (job_t*)malloc(_depth * sizeof(job_t));
+  _lock = xSemaphoreCreateMutex();
+  _space = xSemaphoreCreateCounting(_depth, _depth);
+  _stopped = xSemaphoreCreateCounting(_count, 0);
+
+  if (_shared == NULL || _workers == NULL || _queue == NULL || _lock == NULL || _space == NULL || _stopped == NULL) {
+    ESP_LOGE(PH_TAG, "Failed to create the worker queue");
+    _running = true;
+    end();
+    return ESP_ERR_NO_MEM;
+  }
+
+  _queued = 0;
+  _started = 0;
+  _active = 0;
+  _samples = _nextSample = 0;
+  _p95 = _standing = 0;
+  _intervalStart = millis();
+  _intervalMin = UINT32_MAX;
+  _retryAfter = 1;
+  _stopping = false;
+  _running = true;
+
+  _shared->lock = _lock;
+  _shared->stopped = _stopped;
+  _shared->pool = this;
+  _shared->workers = _workers;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    worker_t* worker = &_workers[i];
+    worker->shared = _shared;
+    worker->reserved = i >= _count - _reserved;
+
+    // nothing gets dispatched to a worker that never started
+    worker->busy = true;
+    if (xTaskCreatePinnedToCore(PsychicWorkerPool::_worker, "async_req_worker", _stackSize, worker, _priority, &worker->handle, _core) != pdPASS) {
+      ESP_LOGE(PH_TAG, "Failed to start async worker %d", i);
+      worker->handle = NULL;
+      continue;
+    }
+    worker->busy = false;
+    _started++;
+  }
+
+  // they only leave once we are stopping, so nobody has touched this yet
+  _shared->running = _started;
+
+  if (!_started) {
+    end();
+    return ESP_FAIL;
+  }
+
+  return ESP_OK;
+}
+
+void PsychicWorkerPool::end()
+{
+  if (!_running)
+    return;
+
+  if (_lock != NULL) {
+    // nobody is going to get to these now. take them out under the lock, a slow client only holds us up
+    std::vector<httpd_req_t*> pending;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stopping = true;
+    for (size_t i = 0; i < _queued; i++)
+      pending.push_back(_queue[i].req);
+    _queued = 0;
+    xSemaphoreGive(_lock);
+
+    for (auto* req : pending) {
+      sendBusy(req);
+      httpd_req_async_handler_complete(req);
+    }
+  }
+
+  // wake every worker, they exit once they have nothing to run
+  for (uint8_t i = 0; _workers != NULL && i < _count; i++) {
+    if (_workers[i].handle != NULL)
+      xTaskNotifyGive(_workers[i].handle);
+  }
+
+  // let them finish the request they are on
+  bool clean = true;
+  TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(ASYNC_WORKER_STOP_TIMEOUT);
+  for (uint8_t i = 0; i < _started; i++) {
+    TickType_t now = xTaskGetTickCount();
+    if (now >= deadline || xSemaphoreTake(_stopped, deadline - now) != pdTRUE) {
+      clean = false;
+      break;
+    }
+  }
+
+  _started = 0;
+  _running = false;
+
+  // a worker still stuck in a handler keeps the shared state, the last of them frees it once
+  // its handler returns. it never touches the pool again, so the rest can go.
+  if (!clean && _shared != NULL) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    bool stuck = _shared->running > 0;
+    if (stuck)
+      _shared->pool = NULL;
+    xSemaphoreGive(_lock);
+
+    if (stuck) {
+      ESP_LOGE(PH_TAG, "Async workers did not stop within %d ms", ASYNC_WORKER_STOP_TIMEOUT);
+      _shared = NULL;
+      _workers = NULL;
+      _lock = _stopped = NULL;
+    }
+  }
+
+  _free();
+}
+
+void PsychicWorkerPool::_free()
+{
+  // the last worker may still be on its way out of _exit()
+  if (_lock) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    xSemaphoreGive(_lock);
+  }
+
+  free(_shared);
+  _shared = NULL;
+  free(_workers);
+  _workers = NULL;
+  free(_queue);
+  _queue = NULL;
+  if (_lock)
+    vSemaphoreDelete(_lock);
+  if (_space)
+    vSemaphoreDelete(_space);
+  if (_stopped)
+    vSemaphoreDelete(_stopped);
+  _lock = _space = _stopped = NULL;
+}
+
+bool PsychicWorkerPool::isWorkerThread()
+{
+  // is our handle one of the known async handles?
+  TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+  for (uint8_t i = 0; _workers != NULL && i < _count; i++) {
+    if (_workers[i].handle == handle)
+      return true;
+  }
+  return false;
+}
+
+bool PsychicWorkerPool::admit(uint32_t target_ms, size_t max_queued)
+{
+  if (!_running || (!target_ms && !max_queued))
+    return true;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+
+  bool admitted = true;
+  if (max_queued && _queued >= max_queued)
+    admitted = false;
+  // a free worker means it starts right away, which also lets a stale p95 recover once things calm down
+  else if (target_ms && _active >= _started && (_p95 > target_ms || (_queued && _standing > target_ms)))
+    admitted = false;
+
+  if (!admitted)
+    _rejected++;
+
+  xSemaphoreGive(_lock);
+  return admitted;
+}
+
+esp_err_t PsychicWorkerPool::submit(httpd_req_t* req, httpd_req_handler_t handler, uint8_t priority)
+{
+  if (!_running || _stopping)
+    return ESP_FAIL;
+
+  // must create a copy of the request that we own
+  httpd_req_t* copy = NULL;
+  esp_err_t err = httpd_req_async_handler_begin(req, &copy);
+  if (err != ESP_OK)
+    return err;
+
+  job_t job = {copy, handler, priority, 0, millis()};
+
+  TickType_t ticks = _admission == WORKER_WAIT ? pdMS_TO_TICKS(_admissionTimeout) : 0;
+  bool admitted = xSemaphoreTake(_space, ticks) == pdTRUE;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  job.sequence = _sequence++;
+
+  if (_stopping) {
+    if (admitted)
+      xSemaphoreGive(_space);
+    admitted = false;
+  } else if (admitted) {
+    _queue[_queued++] = job;
+    _dispatch();
+  } else if (_admission == WORKER_SHED) {
+    // bump the newest of the lowest priority jobs, if it is below us
+    size_t victim = _queued;
+    for (size_t i = 0; i < _queued; i++) {
+      if (_queue[i].priority >= priority)
+        continue;
+      if (victim == _queued || _queue[i].priority < _queue[victim].priority ||
+          (_queue[i].priority == _queue[victim].priority && _queue[i].sequence > _queue[victim].sequence))
+        victim = i;
+    }
+
+    if (victim < _queued) {
+      job_t shed = _queue[victim];
+      _queue[victim] = job;
+      _shed++;
+      _dispatch();
+      xSemaphoreGive(_lock);
+
+      sendBusy(shed.req);
+      httpd_req_async_handler_complete(shed.req);
+      return ESP_OK;
+    }
+  }
+
+  if (!admitted)
+    _rejected++;
+  xSemaphoreGive(_lock);
+
+  if (!admitted) {
+    ESP_LOGE(PH_TAG, "No workers are available");
+    httpd_req_async_handler_complete(copy); // cleanup
+    return ESP_FAIL;
+  }
+
+  return ESP_OK;
+}
+
+// hands queued jobs to idle workers, must be called with _lock held
+void PsychicWorkerPool::_dispatch()
+{
+  while (_queued) {
+    // highest priority first, oldest first within a priority
+    size_t best = 0;
+    for (size_t i = 1; i < _queued; i++) {
+      if (_queue[i].priority > _queue[best].priority ||
+          (_queue[i].priority == _queue[best].priority && _queue[i].sequence < _queue[best].sequence))
+        best = i;
+    }
+
+    // only high priority jobs may take a reserved worker, and only once the others are busy.
+    // if the best job can't be placed, nothing below it can either.
+    bool high = _queue[best].priority >= PRIORITY_HIGH;
+    worker_t* worker = NULL;
+    for (uint8_t i = 0; i < _count; i++) {
+      worker_t* w = &_workers[i];
+      if (w->busy || (w->reserved && !high))
+        continue;
+      if (worker == NULL || (worker->reserved && !w->reserved))
+        worker = w;
+    }
+    if (worker == NULL)
+      return;
+
+    worker->job = _queue[best];
+    worker->busy = true;
+    _active++;
+    _queue[best] = _queue[--_queued];
+    xSemaphoreGive(_space);
+
+    xTaskNotifyGive(worker->handle);
+  }
+}
+
+// must be called with _lock held
+void PsychicWorkerPool::_record(uint32_t sojourn, uint32_t latency)
+{
+  // CoDel: the queue is standing if even the shortest wait of an interval was long
+  unsigned long now = millis();
+  if (now - _intervalStart >= ASYNC_WORKER_ADMISSION_INTERVAL) {
+    _standing = _intervalMin == UINT32_MAX ? 0 : _intervalMin;
+    _intervalMin = UINT32_MAX;
+    _intervalStart = now;
+  }
+  if (sojourn < _intervalMin)
+    _intervalMin = sojourn;
+
+  _latency[_nextSample] = latency;
+  _nextSample = (_nextSample + 1) % ASYNC_WORKER_LATENCY_WINDOW;
+  if (_samples < ASYNC_WORKER_LATENCY_WINDOW)
+    _samples++;
+
+  uint32_t sorted[ASYNC_WORKER_LATENCY_WINDOW];
+  memcpy(sorted, _latency, _samples * sizeof(uint32_t));
+  size_t rank = (_samples * 95 + 99) / 100 - 1;
+  std::nth_element(sorted, sorted + rank, sorted + _samples);
+  _p95 = sorted[rank];
+
+  // roughly how long until the current backlog has drained
+  uint32_t backlog = (uint32_t)(_p95 * (_queued + 1) / (_started ? _started : 1));
+  _retryAfter = std::min<uint32_t>(std::max<uint32_t>((backlog + 999) / 1000, 1), ASYNC_WORKER_MAX_RETRY_AFTER);
+}
+
+// called with shared->lock held, releases it. frees the shared state if we were the last straggler.
+void PsychicWorkerPool::_exit(shared_t* shared)
+{
+  shared->running--;
+  xSemaphoreGive(shared->stopped);
+
+  bool last = shared->pool == NULL && shared->running == 0;
+  xSemaphoreGive(shared->lock);
+
+  if (last) {
+    vSemaphoreDelete(shared->lock);
+    vSemaphoreDelete(shared->stopped);
+    free(shared->workers);
+    free(shared);
+  }
+}
+
+void PsychicWorkerPool::_worker(void* arg)
+{
+  worker_t* worker = (worker_t*)arg;
+  shared_t* shared = worker->shared;
+  ESP_LOGI(PH_TAG, "starting async req task worker");
+
+  while (true) {
+    // wait to be handed a request
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+    PsychicWorkerPool* self = shared->pool;
+    bool busy = worker->busy;
+    bool stopping = self == NULL || self->_stopping;
+
+    if (!busy) {
+      if (stopping)
+        break;
+      xSemaphoreGive(shared->lock);
+      continue;
+    }
+    xSemaphoreGive(shared->lock);
+
+    job_t job = worker->job;
+    ESP_LOGD(PH_TAG, "invoking %s", job.req->uri);
+
+    // call the handler
+    unsigned long started = millis();
+    job.handler(job.req);
+
+    // Inform the server that it can purge the socket used for
+    // this request, if needed.
+    if (httpd_req_async_handler_complete(job.req) != ESP_OK)
+      ESP_LOGE(PH_TAG, "failed to complete async req");
+
+    // we are free again, pick up whatever has been waiting. the pool may have given up on us.
+    xSemaphoreTake(shared->lock, portMAX_DELAY);
+    self = shared->pool;
+    worker->busy = false;
+    if (self == NULL)
+      break;
+
+    self->_record(started - job.queuedAt, millis() - job.queuedAt);
+    self->_active--;
+    if (!self->_stopping)
+      self->_dispatch();
+    xSemaphoreGive(shared->lock);
+  }
+
+  // still holding shared->lock
+  ESP_LOGW(PH_TAG, "worker stopped");
+  _exit(shared);
+  vTaskDelete(NULL);
+}
+
+esp_err_t PsychicWorkerPool::sendBusy(httpd_req_t* req)
+{
+  static const char body[] = "No workers available. Server busy.";
+
+  char retry[12];
+  snprintf(retry, sizeof(retry), "%" PRIu32, _retryAfter);
+
+  httpd_resp_set_status(req, "503 Service Unavailable");
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_set_hdr(req, "Retry-After", retry);
+  return httpd_resp_send(req, body, sizeof(body) - 1);
+}
+
+esp_err_t PsychicWorkerPool::sendBusy(PsychicResponse* response)
+{
+  char retry[12];
+  snprintf(retry, sizeof(retry), "%" PRIu32, _retryAfter);
+
+  response->addHeader("Retry-After", retry);
+  return response->send(503, "text/plain", "No workers available. Server busy.");
+}
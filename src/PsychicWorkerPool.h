@@ -0,0 +1,189 @@
+#ifndef PsychicWorkerPool_h
+#define PsychicWorkerPool_h
+
+#include "PsychicCore.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#ifndef ASYNC_WORKER_TASK_PRIORITY
+  #define ASYNC_WORKER_TASK_PRIORITY 5
+#endif
+
+#ifndef ASYNC_WORKER_TASK_STACK_SIZE
+  #define ASYNC_WORKER_TASK_STACK_SIZE (4 * 1024)
+#endif
+
+#ifndef ASYNC_WORKER_COUNT
+  #define ASYNC_WORKER_COUNT 8
+#endif
+
+// how many requests may wait for a worker once they are all busy
+#ifndef ASYNC_WORKER_QUEUE_DEPTH
+  #define ASYNC_WORKER_QUEUE_DEPTH 1
+#endif
+
+// how long stop() waits for workers to finish what they are running
+#ifndef ASYNC_WORKER_STOP_TIMEOUT
+  #define ASYNC_WORKER_STOP_TIMEOUT 5000
+#endif
+
+// how many finished requests the p95 latency is taken over
+#ifndef ASYNC_WORKER_LATENCY_WINDOW
+  #define ASYNC_WORKER_LATENCY_WINDOW 32
+#endif
+
+// the queue delay counts as standing once it stayed above target for a whole interval (CoDel)
+#ifndef ASYNC_WORKER_ADMISSION_INTERVAL
+  #define ASYNC_WORKER_ADMISSION_INTERVAL 100
+#endif
+
+// upper bound for the Retry-After we hand out, in seconds
+#ifndef ASYNC_WORKER_MAX_RETRY_AFTER
+  #define ASYNC_WORKER_MAX_RETRY_AFTER 30
+#endif
+
+typedef esp_err_t (*httpd_req_handler_t)(httpd_req_t* req);
+
+class PsychicResponse;
+
+// scheduling classes, higher runs first and PRIORITY_HIGH may use the reserved workers
+enum PsychicPriority {
+  PRIORITY_LOW = 0,
+  PRIORITY_NORMAL = 1,
+  PRIORITY_HIGH = 2
+};
+
+// what submit() does when the queue is full
+enum PsychicWorkerAdmission {
+  WORKER_REJECT, // answer 503 right away
+  WORKER_WAIT,   // block the server task for up to the admission timeout, then 503
+  WORKER_SHED    // replace the lowest priority queued request if it is below the new one
+};
+
+/*
+ * PsychicWorkerPool :: runs requests on a set of worker tasks, one pool per server
+ *
+ * Configure it before server.begin(), the workers are started and stopped along with the server.
+ * Queued requests are handed to idle workers highest priority first, and setReserved() keeps some
+ * workers free for PRIORITY_HIGH so a flood of slow low priority requests can't starve them.
+ *
+ * It also keeps a moving p95 of request latency and the standing queue delay, so admit() can turn
+ * requests away with a cheap 503 + Retry-After before they pile up behind the ones already queued.
+ */
+
+class PsychicWorkerPool
+{
+  protected:
+    typedef struct {
+        httpd_req_t* req;
+        httpd_req_handler_t handler;
+        uint8_t priority;
+        uint32_t sequence;
+        unsigned long queuedAt;
+    } job_t;
+
+    struct shared_t;
+
+    typedef struct {
+        shared_t* shared;
+        TaskHandle_t handle;
+        job_t job;
+        bool busy;
+        bool reserved;
+    } worker_t;
+
+    // what the workers hold on to, it outlives the pool if end() gives up on a worker stuck in a handler.
+    // the last of those stragglers frees it.
+    struct shared_t {
+        SemaphoreHandle_t lock;
+        SemaphoreHandle_t stopped;
+        PsychicWorkerPool* pool; // NULL once end() let go
+        worker_t* workers;
+        uint8_t running;
+    };
+
+    uint8_t _count;
+    uint8_t _reserved;
+    uint32_t _stackSize;
+    UBaseType_t _priority;
+    BaseType_t _core;
+    size_t _depth;
+    PsychicWorkerAdmission _admission;
+    uint32_t _admissionTimeout;
+
+    shared_t* _shared;
+    worker_t* _workers;
+    uint8_t _started;
+    bool _running;
+    bool _stopping;
+
+    // jobs waiting for a worker
+    job_t* _queue;
+    size_t _queued;
+    uint32_t _sequence;
+    SemaphoreHandle_t _lock;
+    SemaphoreHandle_t _space;
+    SemaphoreHandle_t _stopped;
+
+    uint32_t _rejected;
+    uint32_t _shed;
+
+    // latency tracking, all guarded by _lock
+    uint8_t _active;
+    uint32_t _latency[ASYNC_WORKER_LATENCY_WINDOW];
+    size_t _samples;
+    size_t _nextSample;
+    uint32_t _p95;
+    unsigned long _intervalStart;
+    uint32_t _intervalMin;
+    uint32_t _standing;
+    uint32_t _retryAfter;
+
+    void _dispatch();
+    void _record(uint32_t sojourn, uint32_t latency);
+    void _free();
+    static void _worker(void* arg);
+    static void _exit(shared_t* shared);
+
+  public:
+    PsychicWorkerPool();
+    ~PsychicWorkerPool();
+
+    // all of these must be set before begin()
+    PsychicWorkerPool* setWorkers(uint8_t count);
+    PsychicWorkerPool* setReserved(uint8_t count); // workers that only take PRIORITY_HIGH
+    PsychicWorkerPool* setStackSize(uint32_t size);
+    PsychicWorkerPool* setPriority(UBaseType_t priority);
+    PsychicWorkerPool* setCore(BaseType_t core); // tskNO_AFFINITY for any
+    PsychicWorkerPool* setQueueDepth(size_t depth);
+    PsychicWorkerPool* setAdmission(PsychicWorkerAdmission policy, uint32_t timeout_ms = 0);
+
+    uint8_t workers() { return _count; }
+    size_t queued() { return _queued; }
+    uint32_t rejected() { return _rejected; }
+    uint32_t shed() { return _shed; }
+    uint32_t p95() { return _p95; }              // ms from submit to finished, over the last requests
+    uint32_t standingDelay() { return _standing; } // ms requests have been waiting for a worker
+    uint32_t retryAfter() { return _retryAfter; }  // seconds, what sendBusy() suggests
+    bool isRunning() { return _running; }
+
+    esp_err_t begin();
+    void end();
+
+    bool isWorkerThread();
+
+    // false when every worker is busy and either the p95 latency or the standing queue delay is over
+    // target_ms, or when max_queued requests are already waiting. 0 disables either check.
+    bool admit(uint32_t target_ms, size_t max_queued = 0);
+
+    // copies the request and queues it, or returns ESP_FAIL if it wasn't admitted
+    esp_err_t submit(httpd_req_t* req, httpd_req_handler_t handler, uint8_t priority = PRIORITY_NORMAL);
+
+    // pre-rendered 503 with a Retry-After estimated from the current latency
+    esp_err_t sendBusy(httpd_req_t* req);
+    // the same 503, through a response so headers added by middleware go out with it
+    esp_err_t sendBusy(PsychicResponse* response);
+};
+
+#endif // PsychicWorkerPool_h
@@ -101,12 +101,47 @@ size_t TemplatePrinter::write(uint8_t data)
   return 1;
 }
 
+size_t TemplatePrinter::write(const uint8_t* buffer, size_t size)
+{
+  size_t i = 0;
+
+  while (i < size)
+  {
+    // Outside a parameter, everything up to the next delimiter goes straight through
+    if (!_inParam)
+    {
+      const uint8_t* next = (const uint8_t*)memchr(buffer + i, _delimiter, size - i);
+      size_t span = next ? next - (buffer + i) : size - i;
+
+      if (span)
+      {
+        _stream.write(buffer + i, span);
+        i += span;
+      }
+
+      if (!next)
+        break;
+    }
+
+    // Delimiters and parameter names go through the byte parser
+    write(buffer[i++]);
+  }
+  return size;
+}
+
 size_t TemplatePrinter::copyFrom(Stream& stream)
 {
   size_t count = 0;
+  uint8_t buffer[128];
 
   while (stream.available())
-    count += this->write(stream.read());
+  {
+    size_t len = stream.readBytes(buffer, std::min((size_t)stream.available(), sizeof(buffer)));
+    if (!len)
+      break;
+
+    count += this->write(buffer, len);
+  }
 
   return count;
 }